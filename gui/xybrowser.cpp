@@ -74,10 +74,15 @@ void PreviewPlot::draw(wxDC &dc, bool)
                   ycol.get_min(), ycol.get_max(np));
     draw_axis_labels(dc, xcol.get_name(), ycol.get_name());
 
+    if (np <= 0)
+        return;
     // draw data
+    vector<double> xs(np), ys(np);
+    xcol.get_values(0, np, &xs[0]);
+    ycol.get_values(0, np, &ys[0]);
     dc.SetPen(*wxGREEN_PEN);
     for (int i = 0; i < np; ++i)
-        draw_point(dc, xcol.get_value(i), ycol.get_value(i));
+        draw_point(dc, xs[i], ys[i]);
 }
 
 void PreviewPlot::load_dataset(string const& filename,
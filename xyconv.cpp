@@ -5,6 +5,8 @@
 #include <fstream>
 #include <iomanip>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <string.h>
 
 #include "xylib/xylib.h"
@@ -126,9 +128,10 @@ void print_filetype_info(string const& filetype)
 
 void export_metadata(FILE *f, xylib::MetaData const& meta)
 {
-    for (size_t i = 0; i != meta.size(); ++i) {
-        const string& key = meta.get_key(i);
-        const string& value = meta.get(key);
+    for (xylib::MetaData::const_iterator i = meta.begin(); i != meta.end();
+                                                                         ++i) {
+        const string& key = i.key();
+        const string& value = i.value();
         string::size_type pos = 0;
         for (;;) {
             string::size_type new_pos = value.find('\n', pos);
@@ -183,15 +186,33 @@ void export_plain_text(xylib::DataSet const *d, string const &fname,
         }
         fprintf(f, "\n");
 
-        int nrow = block->get_point_count();
+        xylib_index_t nrow = block->get_point_count64();
 
-        for (int j = 0; j < nrow; ++j) {
-            for (int k = 1; k <= ncol; ++k) {
-                if (k > 1)
-                    fprintf(f, "\t");
-                fprintf(f, "%.6f", block->get_column(k).get_value(j));
+        // values are fetched in chunks, it's faster than calling get_value()
+        // for each point
+        const int chunk = 4096;
+        vector<double> buf(ncol * chunk);
+        vector<const double*> vals(ncol);
+        for (xylib_index_t j0 = 0; j0 < nrow; j0 += chunk) {
+            int n = (int) min((xylib_index_t) chunk, nrow - j0);
+            for (int k = 0; k < ncol; ++k) {
+                xylib::Column const& col = block->get_column(k+1);
+                const double* data = col.get_data_pointer();
+                if (data != NULL) {
+                    vals[k] = data + j0;
+                } else {
+                    col.get_values64(j0, n, &buf[k * chunk]);
+                    vals[k] = &buf[k * chunk];
+                }
+            }
+            for (int j = 0; j < n; ++j) {
+                for (int k = 0; k < ncol; ++k) {
+                    if (k > 0)
+                        fprintf(f, "\t");
+                    fprintf(f, "%.6f", vals[k][j]);
+                }
+                fprintf(f, "\n");
             }
-            fprintf(f, "\n");
         }
     }
     if (fname != "-")
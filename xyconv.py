@@ -34,7 +34,7 @@ def print_filetype_info(filetype):
 def export_metadata(f, meta):
     for i in range(meta.size()):
         key = meta.get_key(i)
-        value = meta.get(key)
+        value = meta.get_value(i)
         f.write('# %s: %s\n' % (key, value.replace('\n', '\n#\t')))
 
 
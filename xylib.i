@@ -8,6 +8,12 @@
 %}
 %include "std_string.i"
 %include "std_except.i"
+%include "std_pair.i"
+%template(IndexRange) std::pair<int,int>;
+// the slice shares data with the original block
+%newobject xylib::Block::make_slice;
+%newobject xylib::Block::clone;
+%newobject xylib::DataSet::clone;
 
 /* possible improvements:
  *  - better __str__/__repr__
@@ -20,6 +26,21 @@
 %catches(std::runtime_error) load_string(std::string const& buffer,
                                          std::string const& format_name,
                                          std::string const& options="");
+%catches(std::runtime_error) load_memory(const void* data, size_t size,
+                                         std::string const& format_name,
+                                         std::string const& options="");
+
+// in scripting languages use MetaData.get_key(i) and get_value(i)
+%ignore xylib::MetaData::const_iterator;
+%ignore xylib::MetaData::Item;
+%ignore xylib::MetaData::begin;
+%ignore xylib::MetaData::end;
+
+// non-const overloads are for C++ only
+%ignore xylib::DataSet::get_block(int);
+%ignore xylib::Column::release_data;
+%ignore xylib::Column::get_view;
+%ignore xylib::ColumnView;
 
 #if defined(SWIGPYTHON)
 // istream is not wrapped automatically
@@ -27,6 +48,32 @@
 %ignore guess_filetype;
 %ignore check_format;
 
+// load_memory() takes any object with the buffer protocol (bytes,
+// bytearray, memoryview, numpy array) and reads it without copying
+%typemap(in) (const void* data, size_t size) (Py_buffer view, int got_view = 0) {
+    if (PyObject_GetBuffer($input, &view, PyBUF_SIMPLE) < 0) SWIG_fail;
+    got_view = 1;
+    $1 = view.buf;
+    $2 = (size_t) view.len;
+}
+%typemap(freearg) (const void* data, size_t size) {
+    if (got_view$argnum)
+        PyBuffer_Release(&view$argnum);
+}
+
+// Block.release_values(n) returns the values as a new list
+%typemap(in, numinputs=0) std::vector<double>& out (std::vector<double> temp) {
+    $1 = &temp;
+}
+%typemap(argout) std::vector<double>& out {
+    PyObject* list = PyList_New((Py_ssize_t) temp$argnum.size());
+    if (list == NULL) SWIG_fail;
+    for (size_t i = 0; i != temp$argnum.size(); ++i)
+        PyList_SET_ITEM(list, (Py_ssize_t) i,
+                        PyFloat_FromDouble(temp$argnum[i]));
+    $result = SWIG_AppendOutput($result, list);
+}
+
 %#if PY_VERSION_HEX >= 0x03000000
 // buffer in load_string() must be mapped to bytes not string
 %typemap(typecheck) std::string const& buffer %{
@@ -106,8 +106,8 @@ void BrukerRawDataSet::load_version1(std::istream &f)
         f.ignore(72);   // unused fields
         following_range = read_uint32_le(f);
 
-        VecColumn *ycol = new VecColumn();
-
+        FloatColumn *ycol = new FloatColumn;
+        ycol->reserve(cur_range_steps);
         for(unsigned i = 0; i < cur_range_steps; ++i) {
             float y = read_flt_le(f);
             ycol->add_val(y);
@@ -155,7 +155,8 @@ void BrukerRawDataSet::load_version2(std::istream &f)
         blk->meta["TEMP_IN_K"] = Su(read_uint16_le(f));
 
         f.ignore(cur_header_len - 48);  // move ptr to the data_start
-        VecColumn *ycol = new VecColumn;
+        FloatColumn *ycol = new FloatColumn;
+        ycol->reserve(cur_range_steps);
         for(unsigned i = 0; i < cur_range_steps; ++i) {
             float y = read_flt_le(f);
             ycol->add_val(y);
@@ -294,7 +295,9 @@ void BrukerRawDataSet::load_version1_01(std::istream &f)
         StepColumn *xcol = new StepColumn(start_2theta, step_size);
         blk->add_column(xcol);
 
-        VecColumn *ycol = new VecColumn;
+        FloatColumn *ycol = new FloatColumn;
+        if (steps > 0)
+            ycol->reserve(steps);
         for (int i = 0; i < steps; ++i) {
             float y = read_flt_le(f);
             ycol->add_val(y);
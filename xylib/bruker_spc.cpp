@@ -25,7 +25,7 @@ const FormatInfo BrukerSpcDataSet::fmt_info(
 
 );
 
-bool BrukerSpcDataSet::check(std::istream &f, string*)
+bool BrukerSpcDataSet::check(std::istream & /*f*/, string*)
 {
 
   return true;
@@ -38,12 +38,11 @@ void BrukerSpcDataSet::load_data(std::istream &f)
 
   Block* blk = new Block;
 
-  //predefine vectors
-  VecColumn *xcol = new VecColumn;
-  VecColumn *ycol = new VecColumn;
+  //predefine vectors, x is the channel number 1, 2, ...
+  StepColumn *xcol = new StepColumn(1, 1);
+  Int32Column *ycol = new Int32Column;
 
   //initialise values
-  int channel = 1;
   int stop = 0;
 
   //run the import until we struggle
@@ -57,10 +56,6 @@ void BrukerSpcDataSet::load_data(std::istream &f)
       int y = swap_int32(read_int32_le(f));
       ycol -> add_val(y);
 
-      //set x-value and update channel number
-      xcol -> add_val(channel);
-      channel++;
-
     }
 
     //catch the expection and set stop to 1
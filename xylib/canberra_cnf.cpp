@@ -67,16 +67,10 @@ Column* read_energy_callibration(const char* p, Block *blk, int n_channels)
         return NULL;
     for (int i = 0; i != 3; ++i)
         blk->meta["energy calib "+S(i)] = format1<double,16>("%.7g", coef[i]);
-    if (coef[2] != 0.) { // quadr term
-        VecColumn *vc = new VecColumn;
+    if (coef[2] != 0.) // quadr term
         // Comparing results with FitzPeaks and and Cambio 4.0
         // the first channel should have number 1 (not 0).
-        for (int i = 1; i <= n_channels; i++) {
-            double x = coef[0] + coef[1] * i + coef[2] * i * i;
-            vc->add_val(x);
-        }
-        return vc;
-    }
+        return new PolyColumn(coef, 3, 1., n_channels);
     else
         // since we start from ch1, the first value is coef[0] + coef[1]
         return new StepColumn(coef[0]+coef[1], coef[1]);
@@ -132,12 +126,19 @@ float convert_time(const char* p)
 
 void CanberraCnfDataSet::load_data(std::istream &f)
 {
-    string file_string;
-    file_string.reserve(128*1024);
-    file_string.assign((istreambuf_iterator<char>(f)),
-                       istreambuf_iterator<char>());
-    const char* beg = file_string.c_str();
-    const char* end = beg + file_string.size();
+    // the file is parsed in place if it's in memory, otherwise it's copied
+    Scratch<string> scratch_file_string;
+    const char* beg;
+    size_t file_size;
+    if (!get_memory_view(f, &beg, &file_size)) {
+        string& file_string = *scratch_file_string;
+        file_string.reserve(128*1024);
+        file_string.assign((istreambuf_iterator<char>(f)),
+                           istreambuf_iterator<char>());
+        beg = file_string.c_str();
+        file_size = file_string.size();
+    }
+    const char* end = beg + file_size;
 
     int acq_offset = 0, sam_offset = 0, eff_offset = 0, enc_offset = 0,
         chan_offset = 0;
@@ -181,9 +182,9 @@ void CanberraCnfDataSet::load_data(std::istream &f)
                 // Here is a workaround from JF - checking the value at the
                 // offset.
                 if (chan_offset == 0 &&
-                           offset+1 < file_string.size() &&
-                           file_string[offset] == '\x05' &&
-                           file_string[offset+1] == '\x20')
+                           offset+1 < file_size &&
+                           beg[offset] == '\x05' &&
+                           beg[offset+1] == '\x20')
                        chan_offset = offset;
                 break;
             default:
@@ -257,21 +258,17 @@ void CanberraCnfDataSet::load_data(std::istream &f)
         delete xcol;
         throw FormatError("Channel data not found.");
     }
-    VecColumn *ycol = new VecColumn;
+    vector<uint32_t> counts(n_channels);
+    for (int i = 0; i < n_channels; ++i)
+        counts[i] = from_le<uint32_t>(chan_ptr+512+4*i);
     // the two first channels sometimes contain live and real time
-    for (int i = 0; i < 2; ++i) {
-        uint32_t y = from_le<uint32_t>(chan_ptr+512+4*i);
-        if ((int) y == iround(real_time) || (int) y == iround(live_time))
-            y = 0;
-        ycol->add_val(y);
-    }
-    for (int i = 2; i < n_channels; ++i) {
-        uint32_t y = from_le<uint32_t>(chan_ptr+512+4*i);
-        ycol->add_val(y);
-    }
+    for (int i = 0; i < 2; ++i)
+        if ((int) counts[i] == iround(real_time) ||
+                (int) counts[i] == iround(live_time))
+            counts[i] = 0;
 
     blk->add_column(xcol);
-    blk->add_column(ycol);
+    blk->add_column(make_count_column(counts));
     add_block(blk.release());
 }
 
@@ -48,12 +48,21 @@ bool CanberraMcaDataSet::check(istream &f, string*)
 void CanberraMcaDataSet::load_data(std::istream &f)
 {
     const int file_size = 2*512+2048*4;
-    char *all_data = new char[file_size];
-    f.read(all_data, file_size);
-    if (f.gcount() != file_size) {
-        delete [] all_data;
-        throw FormatError("Unexpected end of file.");
+    // the file is parsed in place if it's in memory
+    const char* all_data;
+    size_t size;
+    vector<char> buf;
+    if (!get_memory_view(f, &all_data, &size)) {
+        buf.resize(file_size);
+        f.read(&buf[0], file_size);
+        all_data = &buf[0];
+        size = f.gcount();
     }
+    if (size < (size_t) file_size)
+        throw FormatError("Unexpected end of file.");
+    uint16_t data_offset = from_le<uint16_t>(all_data+24);
+    if ((size_t) data_offset + 4*2048 > size)
+        throw FormatError("Channel data not found.");
 
     double energy_offset = from_pdp11((unsigned char*) all_data + 108);
     double energy_slope = from_pdp11((unsigned char*) all_data + 112);
@@ -63,28 +72,20 @@ void CanberraMcaDataSet::load_data(std::istream &f)
 
     Column *xcol = NULL;
     if (energy_quadr) {
-        VecColumn *vc = new VecColumn;
-        for (int i = 1; i <= 2048; i++) {
-            //FIXME should it be from 1 ?
-            // perhaps from 0 to 2047, description was not clear.
-            double x = energy_offset + energy_slope * i + energy_quadr * i * i;
-            vc->add_val(x);
-        }
-        xcol = vc;
+        double coef[3] = { energy_offset, energy_slope, energy_quadr };
+        //FIXME should it be from 1 ?
+        // perhaps from 0 to 2047, description was not clear.
+        xcol = new PolyColumn(coef, 3, 1., 2048);
     }
     else {
         xcol = new StepColumn(energy_offset+energy_slope, energy_slope);
     }
     blk->add_column(xcol);
 
-    VecColumn *ycol = new VecColumn;
-    uint16_t data_offset = from_le<uint16_t>(all_data+24);
-    for (int i = 0; i < 2048; i++) {
-        uint32_t y = from_le<uint32_t>(all_data + data_offset + 4*i);
-        ycol->add_val(y);
-    }
-    delete [] all_data;
-    blk->add_column(ycol);
+    vector<uint32_t> counts(2048);
+    for (int i = 0; i < 2048; i++)
+        counts[i] = from_le<uint32_t>(all_data + data_offset + 4*i);
+    blk->add_column(make_count_column(counts));
 
     add_block(blk);
 }
@@ -118,8 +118,10 @@ void ChiPlotDataSet::load_data(std::istream &f)
     if (n_points <= 0 || n_ycols <= 0)
         throw FormatError("expected positive number(s) in line 4");
     vector<VecColumn*> cols(n_ycols + 1);
-    for (size_t i = 0; i != cols.size(); ++i)
+    for (size_t i = 0; i != cols.size(); ++i) {
         cols[i] = new VecColumn;
+        cols[i]->reserve(n_points);
+    }
     try {
         for (int i = 0; i != n_points; ++i) {
             line = read_line(f);
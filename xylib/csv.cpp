@@ -203,38 +203,59 @@ bool CsvDataSet::check(istream &f, string* details)
 }
 
 
+// append one row to the columns; missing values are NaN, extra are ignored
+static
+void add_row(const vector<double>& nums, vector<VecColumnBuilder*>& cols)
+{
+    size_t n = min(nums.size(), cols.size());
+    for (size_t i = 0; i != n; ++i)
+        cols[i]->add_val(nums[i]);
+    for (size_t i = n; i < cols.size(); ++i)
+        cols[i]->add_val(numeric_limits<double>::quiet_NaN());
+}
+
 void CsvDataSet::load_data(istream &f)
 {
     bool decimal_comma = has_option("decimal-comma");
 
     vector<vector<double> > data;
     vector<string> column_names;
-    string line;
+    Scratch<string> scratch_line;
+    string& line = *scratch_line;
     line.reserve(100);
 
     char sep = read_4lines(f, decimal_comma, &data, &column_names);
     size_t n_col = data[0].size();
-    while (getline(f, line)) {
-        if (is_space_or_end(line.c_str()))
-            continue;
-        if (decimal_comma)
-            replace(line.begin(), line.end(), ',', '.');
-        int n = append_numbers_from_line(line, sep, &data);
-        if (n == 0)
-            data.pop_back();
+    // values are stored directly in columns, without keeping whole rows
+    vector<VecColumnBuilder*> cols(n_col);
+    for (size_t i = 0; i != n_col; ++i)
+        cols[i] = new VecColumnBuilder;
+    try {
+        for (size_t j = 0; j != data.size(); ++j)
+            add_row(data[j], cols);
+        while (getline(f, line)) {
+            if (is_space_or_end(line.c_str()))
+                continue;
+            if (decimal_comma)
+                replace(line.begin(), line.end(), ',', '.');
+            data.clear();
+            int n = append_numbers_from_line(line, sep, &data);
+            if (n != 0)
+                add_row(data[0], cols);
+        }
+    } catch (...) {
+        purge_all_elements(cols);
+        throw;
     }
 
     Block* blk = new Block;
     for (size_t i = 0; i != n_col; ++i) {
-        VecColumn *col = new VecColumn;
+        VecColumn *col = cols[i]->finish();
         if (column_names.size() > i)
             col->set_name(column_names[i]);
-        col->reserve(data.size());
-        for (size_t j = 0; j != data.size(); ++j)
-            col->add_val(data[j].size() > i ? data[j][i]
-                                      : numeric_limits<double>::quiet_NaN());
         blk->add_column(col);
     }
+    purge_all_elements(cols);
     add_block(blk);
 }
 
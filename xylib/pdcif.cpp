@@ -518,20 +518,28 @@ void t_on_loop_finish::operator()(IteratorT, IteratorT) const
 
 void PdCifDataSet::load_data(std::istream &f)
 {
-    // read file into vector<char>
-    f.unsetf(ios::skipws);
-    vector<char> vec;
-    std::copy(istream_iterator<char>(f), istream_iterator<char>(),
-              std::back_inserter(vec));
-    format_assert(this, vec.size() > 5);
+    // the file is parsed in place if it's in memory,
+    // otherwise it's read into vector<char>
+    const char* beg;
+    size_t size;
+    Scratch<vector<char> > scratch_vec;
+    if (!get_memory_view(f, &beg, &size)) {
+        vector<char>& vec = *scratch_vec;
+        f.unsetf(ios::skipws);
+        std::copy(istream_iterator<char>(f), istream_iterator<char>(),
+                  std::back_inserter(vec));
+        beg = vec.empty() ? NULL : &vec[0];
+        size = vec.size();
+    }
+    format_assert(this, size > 5);
+    const char* end = beg + size;
     // some CIF files have 0x1A character at the end, let's ignore it
-    while (vec.back() == 0x1A)
-        vec.pop_back();
+    while (end > beg && end[-1] == 0x1A)
+        --end;
     DatasetActions actions;
     CifGrammar<DatasetActions> p(actions);
-    parse_info<vector<char>::const_iterator> info =
-        parse(vec.begin(), vec.end(), p);
-    int stop = info.stop - vec.begin();
+    parse_info<const char*> info = parse(beg, end, p);
+    int stop = info.stop - beg;
     format_assert(this, info.full, "Parse error at character " + S(stop));
     int n = (int) actions.block_list.size();
     if (n == 0)
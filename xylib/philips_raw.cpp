@@ -77,6 +77,7 @@ void PhilipsRawDataSet::load_data(std::istream &f)
     }
 
     VecColumn *ycol = new VecColumn;
+    ycol->reserve(pt_cnt);
     for (unsigned i = 0; i < pt_cnt; ++i) {
         // intensities are packed into 2-byte integers in this interesting way
         int packed_y = read_uint16_le(f);
@@ -100,8 +100,11 @@ void RigakuDataSet::load_data(std::istream &f)
                     start = my_strtod(val);
                 else if (key == "STEP")
                     step = my_strtod(val);
-                else if (key == "COUNT")
+                else if (key == "COUNT") {
                     count = my_strtol(val);
+                    if (ycol != NULL && count > 0)
+                        ycol->reserve(count);
+                }
                 else if (key == "GROUP_COUNT")
                     grp_cnt = my_strtol(val);
 
@@ -77,7 +77,8 @@ Block* read_block(istream &f)
         blk->set_name(title);
     }
     // data - first line
-    vector<double> row;
+    Scratch<vector<double> > scratch_row;
+    vector<double>& row = *scratch_row;
     read_numbers(line, row);
     if (row.empty()) {
         delete blk;
@@ -124,6 +124,8 @@ Block* SpectraDataSet::read_block(istream& f)
 
     VecColumn *ycol = new VecColumn;
     ycol->set_name(spectra_name + " [cps]");
+    if (points > 0)
+        ycol->reserve(points);
     for (long i = 0; i != points; ++i) {
         f.getline(line, 32);
         format_assert(this, !f.fail(), "reading cps data failed");
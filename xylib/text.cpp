@@ -62,7 +62,8 @@ void replace_commas_with_dots(string &s)
 
 void TextDataSet::load_data(std::istream &f)
 {
-    string buf;
+    Scratch<string> scratch_buf;
+    string& buf = *scratch_buf;
     if (!getline(f, buf, '\n'))
         throw FormatError("empty file?");
     if (f.eof() && buf.find('\r') != string::npos) {
@@ -78,8 +79,9 @@ void TextDataSet::load_data(std::istream &f)
 void TextDataSet::load_data_with_delim(std::istream &f, char line_delim,
                                        std::string& buf)
 {
-    vector<VecColumn*> cols;
-    vector<double> row; // temporary storage for values from one line
+    vector<VecColumnBuilder*> cols;
+    Scratch<vector<double> > scratch_row;
+    vector<double>& row = *scratch_row; // values from one line
     string title_line;
 
     bool strict = has_option("strict");
@@ -97,125 +99,136 @@ void TextDataSet::load_data_with_delim(std::istream &f, char line_delim,
 
     // read lines until the first data line is read and columns are created
     string last_line;
-    for (;;) {
-        // Basic support for LAMMPS log file.
-        // There is a chance that output from thermo command will be read
-        // properly, but because the LAMMPS log file doesn't have
-        // a well-defined syntax, it can not be guaranteed.
-        // All data blocks (numeric lines after `run' command) should have
-        // the same columns (do not use thermo_style/thermo_modify between
-        // runs).
-        if (!strict && str_startwith(buf, "LAMMPS (")) {
-            last_line_header = true;
-            continue;
-        }
-        if (decimal_comma)
-            replace_commas_with_dots(buf);
-        const char *p = read_numbers(buf, row);
-        // We skip lines with no data.
-        // If there is only one number in first line, skip it if there
-        // is a text after the number.
-        if (row.size() > 1 ||
-                (row.size() == 1 && (strict || *p == '\0' || *p == '#'))) {
-            // columns initialization
-            cols.reserve(row.size());
-            for (size_t i = 0; i != row.size(); ++i) {
-                cols.push_back(new VecColumn);
-                cols[i]->add_val(row[i]);
+    try {
+        for (;;) {
+            // Basic support for LAMMPS log file.
+            // There is a chance that output from thermo command will be read
+            // properly, but because the LAMMPS log file doesn't have
+            // a well-defined syntax, it can not be guaranteed.
+            // All data blocks (numeric lines after `run' command) should have
+            // the same columns (do not use thermo_style/thermo_modify between
+            // runs).
+            if (!strict && str_startwith(buf, "LAMMPS (")) {
+                last_line_header = true;
+                continue;
             }
-            break;
-        }
-        if (last_line_header) {
-            string t = str_trim(buf);
-            if (!t.empty())
-                last_line = (t[0] != '#' ? t : t.substr(1));
-        }
-        if (!getline(f, buf, line_delim))
-            break;
-    }
-
-    // read all the next data lines (the first data line was read above)
-    while (getline(f, buf, line_delim)) {
-        if (decimal_comma)
-            replace_commas_with_dots(buf);
-        read_numbers(buf, row);
-
-        // We silently skip lines with no data.
-        if (row.empty())
-            continue;
-
-        if (row.size() < cols.size()) {
-            // Some non-data lines may start with numbers. The example is
-            // LAMMPS log file. The exceptions below are made to allow plotting
-            // such a file. In strict mode, no exceptions are made.
-            if (!strict) {
-                // if it's the last line, we ignore the line
-                if (f.eof())
-                    break;
-
-                // line with only one number is probably not a data line
-                if (row.size() == 1)
-                    continue;
-
-                // if it's the single line with smaller length, we ignore it
-                vector<double> row2;
-                getline(f, buf, line_delim);
-                if (decimal_comma)
-                    replace_commas_with_dots(buf);
-                read_numbers(buf, row2);
-                if (row2.size() <= 1)
-                    continue;
-                if (row2.size() < cols.size()) {
-                    // add the previous row
-                    for (size_t i = 0; i != row.size(); ++i)
-                        cols[i]->add_val(row[i]);
-                    // number of columns will be shrinked to the size of the
-                    // last row. If the previous row was shorter, shrink
-                    // the last row.
-                    if (row.size() < row2.size())
-                        row2.resize(row.size());
+            if (decimal_comma)
+                replace_commas_with_dots(buf);
+            const char *p = read_numbers(buf, row);
+            // We skip lines with no data.
+            // If there is only one number in first line, skip it if there
+            // is a text after the number.
+            if (row.size() > 1 ||
+                    (row.size() == 1 && (strict || *p == '\0' || *p == '#'))) {
+                // columns initialization
+                cols.reserve(row.size());
+                for (size_t i = 0; i != row.size(); ++i) {
+                    cols.push_back(new VecColumnBuilder);
+                    cols[i]->add_val(row[i]);
                 }
-                // if we are here, row2 needs to be stored
-                row = row2;
+                break;
+            }
+            if (last_line_header) {
+                string t = str_trim(buf);
+                if (!t.empty())
+                    last_line = (t[0] != '#' ? t : t.substr(1));
             }
+            if (!getline(f, buf, line_delim))
+                break;
+        }
+
+        // read all the next data lines (the first data line was read above)
+        while (getline(f, buf, line_delim)) {
+            if (decimal_comma)
+                replace_commas_with_dots(buf);
+            read_numbers(buf, row);
+
+            // We silently skip lines with no data.
+            if (row.empty())
+                continue;
 
-            // this check is not redundant, row may have changed
             if (row.size() < cols.size()) {
-                // decrease the number of columns to the new minimum
-                for (size_t i = row.size(); i != cols.size(); ++i)
-                    delete cols[i];
-                cols.resize(row.size());
+                // Some non-data lines may start with numbers. The example is
+                // LAMMPS log file. The exceptions below are made to allow
+                // plotting such a file. In strict mode, no exceptions are made.
+                if (!strict) {
+                    // if it's the last line, we ignore the line
+                    if (f.eof())
+                        break;
+
+                    // line with only one number is probably not a data line
+                    if (row.size() == 1)
+                        continue;
+
+                    // if it's the single line with smaller length, we ignore it
+                    vector<double> row2;
+                    getline(f, buf, line_delim);
+                    if (decimal_comma)
+                        replace_commas_with_dots(buf);
+                    read_numbers(buf, row2);
+                    if (row2.size() <= 1)
+                        continue;
+                    if (row2.size() < cols.size()) {
+                        // add the previous row
+                        for (size_t i = 0; i != row.size(); ++i)
+                            cols[i]->add_val(row[i]);
+                        // number of columns will be shrinked to the size of the
+                        // last row. If the previous row was shorter, shrink
+                        // the last row.
+                        if (row.size() < row2.size())
+                            row2.resize(row.size());
+                    }
+                    // if we are here, row2 needs to be stored
+                    row = row2;
+                }
+
+                // this check is not redundant, row may have changed
+                if (row.size() < cols.size()) {
+                    // decrease the number of columns to the new minimum
+                    for (size_t i = row.size(); i != cols.size(); ++i)
+                        delete cols[i];
+                    cols.resize(row.size());
+                }
             }
-        }
 
-        else if (row.size() > cols.size()) {
-            // Generally, we ignore extra columns. But if this is the second
-            // data line, we ignore the first line instead.
-            // Rationale: some data files have one or two numbers in the first
-            // line, that can mean number of points or number of colums, and 
-            // the real data starts from the next line.
-            if (cols[0]->get_point_count() == 1) {
-                purge_all_elements(cols);
-                for (size_t i = 0; i != row.size(); ++i)
-                    cols.push_back(new VecColumn);
+            else if (row.size() > cols.size()) {
+                // Generally, we ignore extra columns. But if this is the
+                // second data line, we ignore the first line instead.
+                // Rationale: some data files have one or two numbers in the
+                // first line, that can mean number of points or number of
+                // colums, and the real data starts from the next line.
+                if (cols[0]->size() == 1) {
+                    purge_all_elements(cols);
+                    for (size_t i = 0; i != row.size(); ++i)
+                        cols.push_back(new VecColumnBuilder);
+                }
             }
-        }
 
-        for (size_t i = 0; i != cols.size(); ++i)
-            cols[i]->add_val(row[i]);
+            for (size_t i = 0; i != cols.size(); ++i)
+                cols[i]->add_val(row[i]);
+        }
+    } catch (...) {
+        purge_all_elements(cols);
+        throw;
     }
 
-    format_assert(this, cols.size() >= 1 && cols[0]->get_point_count() >= 2,
-                  "data not found in file.");
+    bool found = (cols.size() >= 1 && cols[0]->size() >= 2);
+    if (!found)
+        purge_all_elements(cols);
+    format_assert(this, found, "data not found in file.");
 
     Block* blk = new Block;
-    for (unsigned i = 0; i < cols.size(); ++i)
-        blk->add_column(cols[i]);
+    vector<VecColumn*> vcols(cols.size());
+    for (unsigned i = 0; i < cols.size(); ++i) {
+        vcols[i] = cols[i]->finish();
+        blk->add_column(vcols[i]);
+    }
+    purge_all_elements(cols);
 
     if (!title_line.empty())
-        use_title_line(title_line, cols, blk);
+        use_title_line(title_line, vcols, blk);
     if (!last_line.empty())
-        use_title_line(last_line, cols, blk);
+        use_title_line(last_line, vcols, blk);
 
     add_block(blk);
 }
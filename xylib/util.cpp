@@ -5,6 +5,7 @@
 #include "util.h"
 #include "xylib.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cctype>  // isspace
 #include <cerrno>
@@ -13,7 +14,9 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib> // strtol, strtod
+#include <functional> // less
 #include <limits>
+#include <new>     // bad_alloc
 #include <boost/detail/endian.hpp>
 #include <boost/cstdint.hpp>
 
@@ -368,6 +371,30 @@ vector<Block*> split_on_column_length(Block *block)
     return result;
 }
 
+bool columns_equal(const Column& a, const Column& b)
+{
+    if (&a == &b)
+        return true;
+    int n = a.get_point_count();
+    if (n != b.get_point_count() || a.get_name() != b.get_name())
+        return false;
+    if (n == -1) // only generators of the same kind can be compared
+        return a.get_kind() == kColumnStep && b.get_kind() == kColumnStep &&
+               a.get_step() == b.get_step() &&
+               a.get_value(0) == b.get_value(0);
+    const int chunk = 512;
+    double va[chunk], vb[chunk];
+    for (int i = 0; i < n; i += chunk) {
+        int k = min(chunk, n - i);
+        a.get_values(i, k, va);
+        b.get_values(i, k, vb);
+        for (int j = 0; j != k; ++j)
+            if (va[j] != vb[j] && !(va[j] != va[j] && vb[j] != vb[j]))
+                return false;
+    }
+    return true;
+}
+
 
 int count_numbers(const char* p)
 {
@@ -393,6 +420,36 @@ void warn(const char *fmt, ...) {
 #endif
 }
 
+std::pair<int,int> StepColumn::find_range(double lo, double hi,
+                                          int point_count) const
+{
+    int n = (count == -1 ? point_count : count);
+    double step = get_step();
+    if (n <= 0 || lo > hi)
+        return std::make_pair(0, 0);
+    if (step == 0)
+        return start >= lo && start <= hi ? std::make_pair(0, n)
+                                          : std::make_pair(0, 0);
+    // for negative step the lower index corresponds to hi
+    double a = (step > 0 ? lo : hi);
+    double b = (step > 0 ? hi : lo);
+    double first_d = std::ceil((a - start) / step);
+    double last_d = std::floor((b - start) / step) + 1;
+    int first = (int) std::max(0., std::min((double) n, first_d));
+    int last = (int) std::max(0., std::min((double) n, last_d));
+    // correct rounding errors, so the result agrees with get_value()
+    while (first > 0 && in_range(start + step * (first-1), lo, hi))
+        --first;
+    while (first < n && !in_range(start + step * first, lo, hi))
+        ++first;
+    last = std::max(last, first);
+    while (last < n && in_range(start + step * last, lo, hi))
+        ++last;
+    while (last > first && !in_range(start + step * (last-1), lo, hi))
+        --last;
+    return std::make_pair(first, last);
+}
+
 // get all numbers in the first legal line
 // sep is _optional_ separator that can be used in addition to white space
 void VecColumn::add_values_from_str(string const& str, char sep)
@@ -415,39 +472,378 @@ void VecColumn::add_values_from_str(string const& str, char sep)
     }
 }
 
-double VecColumn::get_min() const
+MemoryStreambuf::pos_type MemoryStreambuf::seekoff(off_type off,
+                                                   ios_base::seekdir dir,
+                                                   ios_base::openmode which)
 {
-    calculate_min_max();
-    return min_val;
+    off_type base = 0;
+    if (dir == ios_base::cur)
+        base = gptr() - eback();
+    else if (dir == ios_base::end)
+        base = egptr() - eback();
+    return seekpos(pos_type(base + off), which);
 }
 
-double VecColumn::get_max(int /*point_count*/) const
+MemoryStreambuf::pos_type MemoryStreambuf::seekpos(pos_type pos,
+                                                   ios_base::openmode which)
 {
-    calculate_min_max();
-    return max_val;
+    off_type n = pos;
+    if (!(which & ios_base::in) || n < 0 || n > egptr() - eback())
+        return pos_type(off_type(-1));
+    setg(eback(), eback() + n, egptr());
+    return pos;
 }
 
-void VecColumn::calculate_min_max() const
+bool get_memory_view(istream& f, const char** data, size_t* size)
 {
-    // public api of VecColumn don't allow changing data, only appending
-    if ((int) data.size() == last_minmax_length)
+    const MemoryStreambuf* buf = dynamic_cast<MemoryStreambuf*>(f.rdbuf());
+    if (buf == NULL)
+        return false;
+    *data = buf->read_pos();
+    *size = buf->read_end() - buf->read_pos();
+    return true;
+}
+
+void PackedCountColumn::add_chunk(const boost::uint32_t* values, int n)
+{
+    boost::uint32_t all = 0;
+    for (int i = 0; i != n; ++i)
+        all |= values[i];
+    int width = 0;
+    while (width < 32 && (all >> width) != 0)
+        ++width;
+    offsets_.push_back((boost::uint32_t) bits_.size());
+    widths_.push_back((boost::uint8_t) width);
+    if (width == 0)
         return;
+    size_t pos = bits_.size();
+    bits_.resize(pos + width, 0);
+    boost::uint64_t* words = &bits_[pos];
+    for (int i = 0; i != n; ++i) {
+        int bit = i * width;
+        int shift = bit & 63;
+        words[bit >> 6] |= (boost::uint64_t) values[i] << shift;
+        if (shift + width > 64)
+            words[(bit >> 6) + 1] |= (boost::uint64_t) values[i] >> (64-shift);
+    }
+}
 
-    if (data.empty()) {
-        min_val = max_val = 0.;
+double PackedCountColumn::get_value64(xylib_index_t n) const
+{
+    if (n < 0 || n >= count_)
+        throw RunTimeError("point index out of range");
+    size_t chunk = (size_t) (n / kChunk);
+    int width = widths_[chunk];
+    if (width == 0)
+        return 0.;
+    const boost::uint64_t* words = &bits_[offsets_[chunk]];
+    int bit = (int) (n % kChunk) * width;
+    int shift = bit & 63;
+    boost::uint64_t v = words[bit >> 6] >> shift;
+    if (shift + width > 64)
+        v |= words[(bit >> 6) + 1] << (64 - shift);
+    return (double) (v & ((boost::uint64_t(1) << width) - 1));
+}
+
+void PackedCountColumn::get_values64(xylib_index_t first, xylib_index_t count,
+                                     double* out) const
+{
+    if (count <= 0)
         return;
+    if (first < 0 || first + count > count_)
+        throw RunTimeError("point index out of range");
+    xylib_index_t end = first + count;
+    xylib_index_t i = first;
+    while (i < end) {
+        size_t chunk = (size_t) (i / kChunk);
+        int begin = (int) (i % kChunk);
+        int n = (int) std::min((xylib_index_t) (kChunk - begin), end - i);
+        int width = widths_[chunk];
+        if (width == 0) {
+            for (int j = 0; j != n; ++j)
+                out[j] = 0.;
+        } else {
+            const boost::uint64_t* words = &bits_[offsets_[chunk]];
+            const boost::uint64_t mask = (boost::uint64_t(1) << width) - 1;
+            for (int j = 0; j != n; ++j) {
+                int bit = (begin + j) * width;
+                int shift = bit & 63;
+                boost::uint64_t v = words[bit >> 6] >> shift;
+                if (shift + width > 64)
+                    v |= words[(bit >> 6) + 1] << (64 - shift);
+                out[j] = (double) (v & mask);
+            }
+        }
+        out += n;
+        i += n;
+    }
+}
+
+void VecColumnBuilder::add_segment()
+{
+    // small files need small segments; the size of segments grows up to
+    // 64k values (512kB)
+    size_t n = segments_.empty() ? 256
+                                 : std::min(2 * segments_.back()->capacity(),
+                                            (size_t) 65536);
+    segments_.reserve(segments_.size() + 1);
+    std::vector<double>* seg = new std::vector<double>;
+    segments_.push_back(seg);
+    take_scratch(seg);
+    seg->reserve(n);
+}
+
+void VecColumnBuilder::release_segments()
+{
+    for (size_t i = 0; i != segments_.size(); ++i) {
+        give_scratch(segments_[i]);
+        delete segments_[i];
+    }
+    segments_.clear();
+    size_ = 0;
+}
+
+VecColumn* VecColumnBuilder::finish()
+{
+    vector<double> all;
+    all.reserve(size_);
+    for (size_t i = 0; i != segments_.size(); ++i) {
+        all.insert(all.end(), segments_[i]->begin(), segments_[i]->end());
+        // free the memory as soon as possible to lower the peak usage
+        give_scratch(segments_[i]);
+        delete segments_[i];
+        segments_[i] = NULL;
     }
-    min_val = max_val = data[0];
-    for (vector<double>::const_iterator i = data.begin() + 1; i != data.end();
-                                                                         ++i) {
-        if (*i < min_val)
-            min_val = *i;
-        if (*i > max_val)
-            max_val = *i;
+    segments_.clear();
+    size_ = 0;
+    VecColumn* col = new VecColumn;
+    col->take_data(all);
+    return col;
+}
+
+namespace {
+
+// all allocations are aligned to this size
+const size_t kArenaAlign = 16;
+const size_t kMinChunkSize = 64 * 1024;
+
+struct MallocAllocator : public Allocator
+{
+    void* allocate(size_t size) { return malloc(size); }
+    void deallocate(void* ptr, size_t) { free(ptr); }
+};
+
+MallocAllocator malloc_allocator;
+
+XYLIB_THREAD_LOCAL Arena* current_arena = NULL;
+
+size_t align_up(size_t n) { return (n + kArenaAlign - 1) & ~(kArenaAlign-1); }
+
+} // anonymous namespace
+
+Arena::Arena(Allocator* allocator)
+    : allocator_(allocator ? allocator : &malloc_allocator),
+      ptr_(NULL), end_(NULL), reserved_(0), used_(0)
+{
+}
+
+Arena::~Arena()
+{
+    for (size_t i = 0; i != chunks_.size(); ++i)
+        allocator_->deallocate(chunks_[i], chunks_[i]->size);
+}
+
+void* Arena::allocate(size_t size)
+{
+    size = align_up(size);
+    if (size > (size_t) (end_ - ptr_)) {
+        size_t header = align_up(sizeof(Chunk));
+        size_t chunk_size = max(kMinChunkSize, header + size);
+        chunks_.reserve(chunks_.size() + 1);
+        Chunk* chunk = (Chunk*) allocator_->allocate(chunk_size);
+        if (chunk == NULL)
+            throw std::bad_alloc();
+        chunk->size = chunk_size;
+        chunks_.insert(upper_bound(chunks_.begin(), chunks_.end(), chunk,
+                                   std::less<Chunk*>()),
+                       chunk);
+        reserved_ += chunk_size;
+        ptr_ = (char*) chunk + header;
+        end_ = (char*) chunk + chunk_size;
     }
-    last_minmax_length = data.size();
+    void* p = ptr_;
+    ptr_ += size;
+    used_ += size;
+    return p;
 }
 
+// binary search in chunks, so that deleting all objects is not quadratic
+bool Arena::owns(const void* ptr) const
+{
+    Chunk* p = (Chunk*) ptr;
+    vector<Chunk*>::const_iterator i = upper_bound(chunks_.begin(),
+                                        chunks_.end(), p, std::less<Chunk*>());
+    if (i == chunks_.begin())
+        return false;
+    --i;
+    return (const char*) ptr < (const char*) *i + (*i)->size;
+}
+
+Arena* set_current_arena(Arena* arena)
+{
+    Arena* prev = current_arena;
+    current_arena = arena;
+    return prev;
+}
+
+Arena* get_current_arena()
+{
+    return current_arena;
+}
+
+// Objects allocated from the heap have no header, so whether the memory is
+// in the arena is checked when it's deleted.
+void* arena_new(size_t size)
+{
+    if (current_arena != NULL)
+        return current_arena->allocate(size);
+    return ::operator new(size);
+}
+
+void arena_delete(void* ptr)
+{
+    // memory from arena is released together with the arena
+    if (current_arena != NULL && current_arena->owns(ptr))
+        return;
+    ::operator delete(ptr);
+}
+
+} // namespace util
+
+struct LoaderContextImp
+{
+    size_t max_bytes;
+    size_t kept_bytes;
+    std::vector<std::string> strings;
+    std::vector<std::vector<double> > doubles;
+    std::vector<std::vector<char> > chars;
+
+    template<typename T>
+    static size_t bytes(const T& buf)
+    {
+        return buf.capacity() * sizeof(typename T::value_type);
+    }
+
+    template<typename T>
+    void take(std::vector<T>& pool, T* buf)
+    {
+        if (pool.empty())
+            return;
+        kept_bytes -= bytes(pool.back());
+        buf->swap(pool.back());
+        pool.pop_back();
+    }
+
+    template<typename T>
+    void give(std::vector<T>& pool, T* buf)
+    {
+        size_t n = bytes(*buf);
+        if (n == 0 || kept_bytes + n > max_bytes)
+            return;
+        // called from destructors, so failed allocation is ignored
+        try {
+            pool.push_back(T());
+        } catch (std::bad_alloc&) {
+            return;
+        }
+        buf->clear();
+        pool.back().swap(*buf);
+        kept_bytes += n;
+    }
+};
+
+namespace util {
+
+namespace {
+// set by set_loader_context()
+XYLIB_THREAD_LOCAL LoaderContextImp* current_context = NULL;
+}
+
+void take_scratch(std::string* buf)
+{
+    if (current_context)
+        current_context->take(current_context->strings, buf);
+}
+
+void take_scratch(std::vector<double>* buf)
+{
+    if (current_context)
+        current_context->take(current_context->doubles, buf);
+}
+
+void take_scratch(std::vector<char>* buf)
+{
+    if (current_context)
+        current_context->take(current_context->chars, buf);
+}
+
+void give_scratch(std::string* buf)
+{
+    if (current_context)
+        current_context->give(current_context->strings, buf);
+}
+
+void give_scratch(std::vector<double>* buf)
+{
+    if (current_context)
+        current_context->give(current_context->doubles, buf);
+}
+
+void give_scratch(std::vector<char>* buf)
+{
+    if (current_context)
+        current_context->give(current_context->chars, buf);
+}
+
+} // namespace util
+
+LoaderContext::LoaderContext(size_t max_bytes)
+    : imp_(new LoaderContextImp)
+{
+    imp_->max_bytes = max_bytes;
+    imp_->kept_bytes = 0;
+}
+
+LoaderContext::~LoaderContext()
+{
+    if (util::current_context == imp_)
+        util::current_context = NULL;
+    delete imp_;
+}
+
+void LoaderContext::clear()
+{
+    std::vector<std::string>().swap(imp_->strings);
+    std::vector<std::vector<double> >().swap(imp_->doubles);
+    std::vector<std::vector<char> >().swap(imp_->chars);
+    imp_->kept_bytes = 0;
+}
+
+size_t LoaderContext::memory_bytes() const
+{
+    return sizeof(LoaderContextImp) + imp_->kept_bytes
+        + imp_->strings.capacity() * sizeof(std::string)
+        + imp_->doubles.capacity() * sizeof(std::vector<double>)
+        + imp_->chars.capacity() * sizeof(std::vector<char>);
+}
+
+void set_loader_context(LoaderContext* ctx)
+{
+    util::current_context = ctx ? ctx->imp_ : NULL;
+}
+
+namespace util {
+
 //SK:
 //we need byte swapping, howver, the preferred __builtin_bswap32 does not work
 //for all cases
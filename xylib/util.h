@@ -4,14 +4,19 @@
 #ifndef XYLIB_UTIL_H_
 #define XYLIB_UTIL_H_
 
+#include <algorithm>
 #include <cassert>
 #include <cmath>    // floor
 #include <cstdio>   // snprintf
 #include <cstring>  // memcpy
 #include <fstream>
+#include <climits>  // INT_MAX
+#include <limits>
 #include <memory>   // auto_ptr/unique_ptr
 #include <string>
 #include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "xylib.h"
 
@@ -19,6 +24,21 @@
 #pragma warning (disable : 4996) // _snprintf may be unsafe
 #endif
 
+// std::thread and std::mutex are used if they are available (C++11).
+#if __cplusplus-0 >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1700)
+# define XYLIB_USE_STD_MUTEX 1
+#else
+# define XYLIB_USE_STD_MUTEX 0
+#endif
+
+#if __cplusplus-0 >= 201103L
+# define XYLIB_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+# define XYLIB_THREAD_LOCAL __declspec(thread)
+#else
+# define XYLIB_THREAD_LOCAL __thread
+#endif
+
 namespace xylib { namespace util {
 
 void le_to_host(void *ptr, int size);
@@ -52,6 +72,7 @@ inline bool str_startwith(const std::string &str, const std::string &prefix) {
 }
 
 std::string str_tolower(const std::string &str);
+
 bool has_word(const std::string &sentence, const std::string &word);
 
 std::string read_line(std::istream &is);
@@ -114,6 +135,9 @@ const char* read_numbers(std::string const& s,
                          std::vector<double>& row);
 // split block if it has columns with different sizes
 std::vector<Block*> split_on_column_length(Block* block);
+// true if columns have the same name and values (NaN is equal to NaN);
+// used to find axes that can be shared between blocks
+bool columns_equal(const Column& a, const Column& b);
 
 /// count whitespace-separated numbers in string
 int count_numbers(const char* p);
@@ -131,50 +155,318 @@ inline void format_assert(DataSet const* ds, bool condition,
 
 void warn(const char *fmt, ...);
 
+/// heap memory used by the string (0 if it fits in the string object)
+inline size_t string_heap_bytes(std::string const& s)
+{
+    const char* p = s.data();
+    const char* obj = (const char*) &s;
+    return p >= obj && p < obj + sizeof(s) ? 0 : s.capacity() + 1;
+}
+
 class ColumnWithName : public Column
 {
 public:
-    explicit ColumnWithName(double step) : step_(step) {}
+    explicit ColumnWithName(double step, ColumnKind kind=kColumnOther)
+        : Column(kind), step_(step) {}
     virtual std::string const& get_name() const { return name_; }
     void set_name(std::string const& name) { name_ = name; }
     virtual double get_step() const { return step_; }
     virtual void set_step(double step) { step_ = step; }
 
+protected:
+    size_t name_heap_bytes() const { return string_heap_bytes(name_); }
+
 private:
     double step_;
     std::string name_;
 };
 
-// column uses vector<double> to represent the data
-class VecColumn : public ColumnWithName
+template<typename T> struct NativeTypeOf {};
+template<> struct NativeTypeOf<double>
+                            { static const NativeType value = kNativeDouble; };
+template<> struct NativeTypeOf<float>
+                            { static const NativeType value = kNativeFloat; };
+template<> struct NativeTypeOf<boost::int16_t>
+                            { static const NativeType value = kNativeInt16; };
+template<> struct NativeTypeOf<boost::uint16_t>
+                            { static const NativeType value = kNativeUInt16; };
+template<> struct NativeTypeOf<boost::int32_t>
+                            { static const NativeType value = kNativeInt32; };
+template<> struct NativeTypeOf<boost::uint32_t>
+                            { static const NativeType value = kNativeUInt32; };
+
+// Computes ColumnStats from values added in one or more chunks.
+// Loops in add() are simple and branch-free, so the compiler can vectorize
+// them where floating-point rules allow.
+class StatsAccumulator
+{
+public:
+    StatsAccumulator()
+        : lo_(std::numeric_limits<double>::infinity()), hi_(-lo_), sum_(0.),
+          n_(0), nan_(0), inc_(0), dec_(0), last_(0.) {}
+
+    template<typename T>
+    void add(const T* p, xylib_index_t n)
+    {
+        if (n <= 0)
+            return;
+        double lo = lo_, hi = hi_, sum = sum_;
+        xylib_index_t nan = 0, inc = 0, dec = 0;
+        for (xylib_index_t i = 0; i < n; ++i) {
+            double v = p[i];
+            lo = v < lo ? v : lo;
+            hi = v > hi ? v : hi;
+            nan += (v != v);
+        }
+        if (nan == 0)
+            for (xylib_index_t i = 0; i < n; ++i)
+                sum += p[i];
+        else
+            for (xylib_index_t i = 0; i < n; ++i)
+                sum += (p[i] == p[i] ? (double) p[i] : 0.);
+        if (n_ != 0) {
+            inc += (p[0] > last_);
+            dec += (p[0] < last_);
+        }
+        for (xylib_index_t i = 1; i < n; ++i) {
+            inc += (p[i] > p[i-1]);
+            dec += (p[i] < p[i-1]);
+        }
+        lo_ = lo;
+        hi_ = hi;
+        sum_ = sum;
+        n_ += n;
+        nan_ += nan;
+        inc_ += inc;
+        dec_ += dec;
+        last_ = p[n-1];
+    }
+
+    ColumnStats get() const
+    {
+        ColumnStats st;
+        if (n_ == nan_) // 0 if empty, NaN if all values are NaN
+            st.min = st.max = (n_ == 0 ? 0.
+                                    : std::numeric_limits<double>::quiet_NaN());
+        else {
+            st.min = lo_;
+            st.max = hi_;
+        }
+        st.sum = sum_;
+        st.nan_count = nan_;
+        st.monotonic = (dec_ == 0 ? 1 : (inc_ == 0 ? -1 : 0));
+        return st;
+    }
+
+private:
+    double lo_, hi_, sum_;
+    xylib_index_t n_, nan_, inc_, dec_;
+    double last_;
+};
+
+// column uses vector<T> to represent the data, T is the type in which values
+// are stored in the file; values are converted to double only on access
+template<typename T>
+class TypedVecColumn : public ColumnWithName
 {
 public:
-    VecColumn() : ColumnWithName(0.), last_minmax_length(-1) {}
+    explicit TypedVecColumn(ColumnKind kind=kColumnOther)
+        : ColumnWithName(0., kind), stats_length_(0) {}
 
     // implementation of the base interface
-    int get_point_count() const { return (int) data.size(); }
-    double get_value (int n) const
+    int get_point_count() const
+    {
+        return data.size() < (size_t) INT_MAX ? (int) data.size() : INT_MAX;
+    }
+    double get_value (int n) const { return get_value64(n); }
+    void get_values(int first, int count, double* out) const
+                                        { get_values64(first, count, out); }
+    xylib_index_t get_point_count64() const
+                                        { return (xylib_index_t) data.size(); }
+    double get_value64(xylib_index_t n) const
     {
-        if (n < 0 || n >= get_point_count())
+        if (n < 0 || n >= get_point_count64())
             throw RunTimeError("index out of range in VecColumn");
         return data[n];
     }
+    void get_values64(xylib_index_t first, xylib_index_t count,
+                      double* out) const
+    {
+        if (count <= 0)
+            return;
+        if (first < 0 || first + count > get_point_count64())
+            throw RunTimeError("index out of range in VecColumn");
+        const T* p = &data[first];
+        for (xylib_index_t i = 0; i < count; ++i)
+            out[i] = p[i];
+    }
+    NativeType get_native_type() const { return NativeTypeOf<T>::value; }
+    double get_min() const { return get_stats().min; }
+    double get_max(int /*point_count*/=0) const { return get_stats().max; }
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + name_heap_bytes() + data.capacity() * sizeof(T);
+    }
+    ColumnStats get_stats(int /*point_count*/=0) const
+    {
+        // public api doesn't allow changing data, only appending,
+        // so only new values need to be processed
+        if (stats_length_ < data.size()) {
+            stats_.add(&data[stats_length_],
+                       (xylib_index_t) (data.size() - stats_length_));
+            stats_length_ = data.size();
+        }
+        return stats_.get();
+    }
+
+    void add_val(T val) { data.push_back(val); }
+    // n is usually read from a file header; it's limited, so that a damaged
+    // header doesn't cause a huge allocation
+    void reserve(size_t n) { data.reserve(std::min(n, (size_t) 1 << 24)); }
+    void shrink_to_fit()
+    {
+        if (data.capacity() > data.size())
+            std::vector<T>(data).swap(data);
+    }
+    // takes over the content of v, which is left empty
+    void take_data(std::vector<T>& v)
+    {
+        data.swap(v);
+        std::vector<T>().swap(v);
+        reset_stats();
+    }
+
+protected:
+    std::vector<T> data;
+
+    void reset_stats()
+    {
+        stats_ = StatsAccumulator();
+        stats_length_ = 0;
+    }
+
+private:
+    mutable StatsAccumulator stats_;
+    mutable size_t stats_length_; // number of values added to stats_
+};
+
+typedef TypedVecColumn<float> FloatColumn;
+typedef TypedVecColumn<boost::int16_t> Int16Column;
+typedef TypedVecColumn<boost::uint16_t> UInt16Column;
+typedef TypedVecColumn<boost::int32_t> Int32Column;
+typedef TypedVecColumn<boost::uint32_t> UInt32Column;
 
-    void add_val(double val) { data.push_back(val); }
+// column uses vector<double> to represent the data
+class VecColumn : public TypedVecColumn<double>
+{
+public:
+    VecColumn() : TypedVecColumn<double>(kColumnArray) {}
+
+    const double* get_data_pointer() const
+    {
+        return data.empty() ? NULL : &data[0];
+    }
+    bool release_data(std::vector<double>& out)
+    {
+        out.swap(data);
+        std::vector<double>().swap(data);
+        reset_stats();
+        return true;
+    }
     void add_values_from_str(std::string const& str, char sep=' ');
-    double get_min() const;
-    double get_max(int point_count=0) const;
-    void reserve(size_t n) { data.reserve(n); }
+};
+
+// Input streambuf that reads from memory (a memory-mapped file,
+// a decompressed file, etc.) without copying it.
+class MemoryStreambuf : public std::streambuf
+{
+public:
+    MemoryStreambuf() {}
+    MemoryStreambuf(const char* data, size_t size) { set_buffer(data, size); }
+    // the part of the buffer that was not read yet
+    const char* read_pos() const { return gptr(); }
+    const char* read_end() const { return egptr(); }
 
 protected:
-    std::vector<double> data;
-    mutable double min_val, max_val;
-    mutable int last_minmax_length;
+    void set_buffer(const char* data, size_t size)
+    {
+        char* p = const_cast<char*>(data); // the buffer is never written
+        setg(p, p, p + size);
+    }
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which);
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which);
+};
+
+// If f reads from memory (MemoryStreambuf), sets data and size to the not
+// yet read part of the stream and returns true. It lets readers that need
+// the whole file parse it in place, without copying.
+bool get_memory_view(std::istream& f, const char** data, size_t* size);
+
+// Buffers are taken from and given back to the LoaderContext set in this
+// thread (see set_loader_context()). Without a context take_scratch() does
+// nothing and give_scratch() leaves the buffer to its owner.
+void take_scratch(std::string* buf);
+void take_scratch(std::vector<double>* buf);
+void take_scratch(std::vector<char>* buf);
+void give_scratch(std::string* buf);
+void give_scratch(std::vector<double>* buf);
+void give_scratch(std::vector<char>* buf);
+
+// Local buffer of type std::string, std::vector<double> or std::vector<char>
+// that reuses the capacity kept in the current LoaderContext.
+template<typename T>
+class Scratch
+{
+public:
+    Scratch() { take_scratch(&buf_); }
+    ~Scratch() { give_scratch(&buf_); }
+    T& operator*() { return buf_; }
+    T* operator->() { return &buf_; }
+
+private:
+    T buf_;
+
+    Scratch(const Scratch&); // disallow
+    void operator=(const Scratch&); // disallow
+};
+
+// Collects values of a column of unknown length in segments, so that values
+// already stored are never copied when more are appended (vector::push_back
+// copies everything on each reallocation and needs up to 3x the final size
+// at peak). finish() copies the values once into an exactly-sized VecColumn.
+class VecColumnBuilder
+{
+public:
+    VecColumnBuilder() : size_(0) {}
+    ~VecColumnBuilder() { release_segments(); }
+
+    void add_val(double val)
+    {
+        if (segments_.empty() ||
+                segments_.back()->size() == segments_.back()->capacity())
+            add_segment();
+        segments_.back()->push_back(val);
+        ++size_;
+    }
+    size_t size() const { return size_; }
+    // moves the values to a new column, the builder is left empty
+    VecColumn* finish();
+
+private:
+    std::vector<std::vector<double>*> segments_;
+    size_t size_;
 
-    void calculate_min_max() const;
+    void add_segment();
+    void release_segments();
 };
 
 
+inline bool in_range(double value, double lo, double hi)
+{
+    return value >= lo && value <= hi;
+}
+
 // column of fixed-step data
 class StepColumn : public ColumnWithName
 {
@@ -184,7 +476,7 @@ public:
 
     // get_min() and get_max() work properly only if step_ >= 0
     StepColumn(double start_, double step_, int count_ = -1)
-        : ColumnWithName(step_), start(start_), count(count_)
+        : ColumnWithName(step_, kColumnStep), start(start_), count(count_)
     {}
 
     int get_point_count() const { return count; }
@@ -194,6 +486,29 @@ public:
             throw RunTimeError("point index out of range");
         return start + get_step() * n;
     }
+    void get_values(int first, int count, double* out) const
+                                        { get_values64(first, count, out); }
+    // count is int, but unlimited columns can be read past 2^31
+    double get_value64(xylib_index_t n) const
+    {
+        if (n < 0 || (count != -1 && n >= count))
+            throw RunTimeError("point index out of range");
+        return start + get_step() * n;
+    }
+    void get_values64(xylib_index_t first, xylib_index_t count,
+                      double* out) const
+    {
+        if (count <= 0)
+            return;
+        if (first < 0 || (this->count != -1 && first + count > this->count))
+            throw RunTimeError("point index out of range");
+        // the same formula as in get_value(), so the results are identical;
+        // this loop is easily vectorized by the compiler
+        const double x0 = start;
+        const double step = get_step();
+        for (xylib_index_t i = 0; i < count; ++i)
+            out[i] = x0 + step * (first + i);
+    }
     double get_min() const { return start; }
     double get_max(int point_count=0) const
     {
@@ -201,8 +516,339 @@ public:
         int n = (count == -1 ? point_count : count);
         return get_value(n-1);
     }
+    ColumnStats get_stats(int point_count=0) const
+    {
+        int n = (count == -1 ? point_count : count);
+        double step = get_step();
+        double last = start + step * (n - 1);
+        ColumnStats st;
+        st.min = n > 0 ? std::min(start, last) : 0.;
+        st.max = n > 0 ? std::max(start, last) : 0.;
+        st.sum = n * start + step * (0.5 * n * (n - 1));
+        st.nan_count = 0;
+        st.monotonic = (step >= 0 ? 1 : -1);
+        return st;
+    }
+    std::pair<int,int> find_range(double lo, double hi,
+                                  int point_count=0) const;
+    size_t memory_bytes() const { return sizeof(*this) + name_heap_bytes(); }
+};
+
+// column of values calculated from polynomial (e.g. energy calibration):
+// value of n'th point is coef[0] + coef[1]*x + coef[2]*x^2 + ...,
+// where x = x0 + n. Nothing is stored per point.
+class PolyColumn : public ColumnWithName
+{
+public:
+    PolyColumn(const double* coef, int ncoef, double x0, int count)
+        : ColumnWithName(0.), coef_(coef, coef + ncoef), x0_(x0),
+          count_(count)
+    {
+        assert(ncoef > 0 && count >= 0);
+        // computed here, so that shared columns are never modified
+        stats_ = Column::get_stats();
+    }
+
+    int get_point_count() const { return count_; }
+    double get_value(int n) const { return get_value64(n); }
+    void get_values(int first, int count, double* out) const
+                                        { get_values64(first, count, out); }
+    double get_value64(xylib_index_t n) const
+    {
+        if (n < 0 || n >= count_)
+            throw RunTimeError("point index out of range");
+        return calculate(x0_ + n);
+    }
+    void get_values64(xylib_index_t first, xylib_index_t count,
+                      double* out) const
+    {
+        if (count <= 0)
+            return;
+        if (first < 0 || first + count > count_)
+            throw RunTimeError("point index out of range");
+        for (xylib_index_t i = 0; i < count; ++i)
+            out[i] = calculate(x0_ + (first + i));
+    }
+    double get_min() const { return get_stats().min; }
+    double get_max(int /*point_count*/=0) const { return get_stats().max; }
+    ColumnStats get_stats(int /*point_count*/=0) const { return stats_; }
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + name_heap_bytes()
+               + coef_.capacity() * sizeof(double);
+    }
+
+private:
+    std::vector<double> coef_;
+    double x0_;
+    int count_;
+    ColumnStats stats_;
+
+    // Horner's method
+    double calculate(double x) const
+    {
+        double y = coef_.back();
+        for (int i = (int) coef_.size() - 2; i >= 0; --i)
+            y = y * x + coef_[i];
+        return y;
+    }
+};
+
+// Compact column for counts (non-negative integers < 2^32), such as
+// spectra, which are mostly zeros and small numbers. Values are stored
+// in chunks of 64; each chunk is bit-packed with the width of its largest
+// value, so a chunk of zeros takes no space apart from the chunk header.
+class PackedCountColumn : public ColumnWithName
+{
+public:
+    template<typename T>
+    PackedCountColumn(const T* values, xylib_index_t n)
+        : ColumnWithName(0.), count_(n)
+    {
+        StatsAccumulator acc;
+        boost::uint32_t buf[kChunk];
+        offsets_.reserve((size_t) (n / kChunk + 1));
+        widths_.reserve((size_t) (n / kChunk + 1));
+        for (xylib_index_t i = 0; i < n; i += kChunk) {
+            int k = (int) std::min((xylib_index_t) kChunk, n - i);
+            for (int j = 0; j != k; ++j)
+                buf[j] = (boost::uint32_t) values[i+j];
+            add_chunk(buf, k);
+            acc.add(buf, k);
+        }
+        stats_ = acc.get();
+    }
+
+    int get_point_count() const
+    {
+        return count_ < (xylib_index_t) INT_MAX ? (int) count_ : INT_MAX;
+    }
+    double get_value(int n) const { return get_value64(n); }
+    void get_values(int first, int count, double* out) const
+                                        { get_values64(first, count, out); }
+    xylib_index_t get_point_count64() const { return count_; }
+    double get_value64(xylib_index_t n) const;
+    void get_values64(xylib_index_t first, xylib_index_t count,
+                      double* out) const;
+    double get_min() const { return stats_.min; }
+    double get_max(int /*point_count*/=0) const { return stats_.max; }
+    ColumnStats get_stats(int /*point_count*/=0) const { return stats_; }
+    void shrink_to_fit()
+    {
+        if (offsets_.capacity() > offsets_.size())
+            std::vector<boost::uint32_t>(offsets_).swap(offsets_);
+        if (widths_.capacity() > widths_.size())
+            std::vector<boost::uint8_t>(widths_).swap(widths_);
+        if (bits_.capacity() > bits_.size())
+            std::vector<boost::uint64_t>(bits_).swap(bits_);
+    }
+    size_t memory_bytes() const
+    {
+        return sizeof(*this) + name_heap_bytes()
+               + offsets_.capacity() * sizeof(boost::uint32_t)
+               + widths_.capacity() + bits_.capacity() * 8;
+    }
+
+    // returns true if values can be stored in this column: they are
+    // non-negative integers that fit in 32 bits
+    template<typename T>
+    static bool can_store(const T* values, xylib_index_t n)
+    {
+        for (xylib_index_t i = 0; i < n; ++i) {
+            double d = values[i];
+            if (!(d >= 0 && d <= 4294967295. && d == std::floor(d)))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    static const int kChunk = 64;
+    xylib_index_t count_;
+    // for each chunk: position in bits_ and number of bits per value;
+    // a chunk with width w takes exactly w words
+    std::vector<boost::uint32_t> offsets_;
+    std::vector<boost::uint8_t> widths_;
+    std::vector<boost::uint64_t> bits_;
+    ColumnStats stats_;
+
+    void add_chunk(const boost::uint32_t* values, int n);
+};
+
+// Column for counts read from a file. Values are bit-packed
+// (PackedCountColumn) if they are counts and it saves at least half
+// of the memory, otherwise the vector is moved to a column of T.
+// values is left empty.
+template<typename T>
+Column* make_count_column(std::vector<T>& values)
+{
+    xylib_index_t n = (xylib_index_t) values.size();
+    const T* p = values.empty() ? NULL : &values[0];
+    if (PackedCountColumn::can_store(p, n)) {
+        PackedCountColumn* packed = new PackedCountColumn(p, n);
+        packed->shrink_to_fit();
+        if (packed->memory_bytes() <= n * sizeof(T) / 2) {
+            std::vector<T>().swap(values);
+            return packed;
+        }
+        delete packed;
+    }
+    TypedVecColumn<T>* col = new TypedVecColumn<T>;
+    col->take_data(values);
+    return col;
+}
+
+// column that refers to points [first, first+count) of another column,
+// which is kept alive by this one;
+// kColumnStep is not kept, because start + n*step of the slice could differ
+// from the value in the base column in the last bit
+class SliceColumn : public Column
+{
+public:
+    SliceColumn(boost::shared_ptr<const Column> const& base,
+                int first, int count)
+        : Column(base->get_kind() == kColumnArray ? kColumnArray
+                                                  : kColumnOther),
+          base_(base), first_(first), count_(count)
+    {
+        assert(first >= 0 && count >= 0);
+        // computed here, so that shared columns are never modified
+        stats_ = Column::get_stats();
+    }
+
+    std::string const& get_name() const { return base_->get_name(); }
+    int get_point_count() const { return count_; }
+    double get_value(int n) const { return get_value64(n); }
+    void get_values(int first, int count, double* out) const
+                                        { get_values64(first, count, out); }
+    double get_value64(xylib_index_t n) const
+    {
+        if (n < 0 || n >= count_)
+            throw RunTimeError("point index out of range");
+        return base_->get_value64(first_ + n);
+    }
+    void get_values64(xylib_index_t first, xylib_index_t count,
+                      double* out) const
+    {
+        if (count <= 0)
+            return;
+        if (first < 0 || first + count > count_)
+            throw RunTimeError("point index out of range");
+        base_->get_values64(first_ + first, count, out);
+    }
+    const double* get_data_pointer() const
+    {
+        const double* ptr = base_->get_data_pointer();
+        return ptr != NULL && count_ != 0 ? ptr + first_ : NULL;
+    }
+    NativeType get_native_type() const { return base_->get_native_type(); }
+    double get_step() const { return base_->get_step(); }
+    double get_min() const { return get_stats().min; }
+    double get_max(int /*point_count*/=0) const { return get_stats().max; }
+    ColumnStats get_stats(int /*point_count*/=0) const { return stats_; }
+    // data of the base column is not counted
+    size_t memory_bytes() const { return sizeof(*this); }
+
+private:
+    boost::shared_ptr<const Column> base_;
+    int first_;
+    int count_;
+    ColumnStats stats_;
+};
+
+// column returned by Block::del_column() if the removed column is still
+// used by other blocks (see Block::clone()) or is in an arena that is not
+// current; values are read from the shared column, release_data() and
+// shrink_to_fit() do nothing, so the other blocks are not affected
+class SharedColumn : public Column
+{
+public:
+    explicit SharedColumn(boost::shared_ptr<Column> const& base)
+        : Column(base->get_kind()), base_(base) {}
+
+    std::string const& get_name() const { return base_->get_name(); }
+    int get_point_count() const { return base_->get_point_count(); }
+    double get_value(int n) const { return base_->get_value(n); }
+    void get_values(int first, int count, double* out) const
+                                { base_->get_values(first, count, out); }
+    xylib_index_t get_point_count64() const
+                                { return base_->get_point_count64(); }
+    double get_value64(xylib_index_t n) const
+                                { return base_->get_value64(n); }
+    void get_values64(xylib_index_t first, xylib_index_t count,
+                      double* out) const
+                                { base_->get_values64(first, count, out); }
+    const double* get_data_pointer() const
+                                { return base_->get_data_pointer(); }
+    NativeType get_native_type() const { return base_->get_native_type(); }
+    double get_step() const { return base_->get_step(); }
+    double get_min() const { return base_->get_min(); }
+    double get_max(int point_count=0) const
+                                { return base_->get_max(point_count); }
+    ColumnStats get_stats(int point_count=0) const
+                                { return base_->get_stats(point_count); }
+    std::pair<int,int> find_range(double lo, double hi,
+                                  int point_count=0) const
+    {
+        return base_->find_range(lo, hi, point_count);
+    }
+    // the shared column is counted where it's owned
+    size_t memory_bytes() const { return sizeof(*this); }
+
+private:
+    boost::shared_ptr<const Column> base_;
+};
+
+// Monotonic (bump) allocator. Memory is released only in the destructor.
+class Arena
+{
+public:
+    explicit Arena(Allocator* allocator);
+    ~Arena();
+    void* allocate(size_t size);
+    // true if ptr was returned by allocate()
+    bool owns(const void* ptr) const;
+    // memory obtained from the allocator but not handed out
+    size_t unused_bytes() const { return reserved_ - used_; }
+
+private:
+    struct Chunk
+    {
+        size_t size;
+    };
+    Allocator* allocator_;
+    std::vector<Chunk*> chunks_; // sorted by address
+    char* ptr_;
+    char* end_;
+    size_t reserved_;
+    size_t used_;
+
+    Arena(const Arena&); // disallow
+    void operator=(const Arena&); // disallow
 };
 
+// Set arena used by arena_new() in this thread (NULL means the heap).
+// Returns previously set arena.
+Arena* set_current_arena(Arena* arena);
+Arena* get_current_arena();
+
+// Sets current arena for the lifetime of the object.
+class ArenaScope
+{
+public:
+    explicit ArenaScope(Arena* arena) : prev_(set_current_arena(arena)) {}
+    ~ArenaScope() { set_current_arena(prev_); }
+private:
+    Arena* prev_;
+};
+
+// Used by operator new and delete of classes that can be allocated in
+// an arena. The object is allocated in the current arena, if it is set.
+// Objects from an arena must be deleted when their arena is current,
+// memory of other objects is freed.
+void* arena_new(size_t size);
+void arena_delete(void* ptr);
+
 /// SK: Add declaration of swapping of signed integer binaries
 int swap_int32(int val);
 
@@ -421,6 +421,10 @@ Block* VamasDataSet::read_block(istream &f, bool includes[],
     xcol->set_name(x_name);
     block->add_column(xcol);
 
+    if (cur_blk_steps > 0)
+        for (int i = 0; i != cor_var; ++i)
+            ycols[i]->reserve(cur_blk_steps / cor_var + 1);
+
     int col = 0;
     assert(ycols.size() == (size_t) cor_var);
     for (int i = 0; i < cur_blk_steps; ++i) {
@@ -5,11 +5,15 @@
 #include "winspec_spe.h"
 
 #include <cmath>
+#include <boost/cstdint.hpp>
 
 #include "util.h"
 
 using namespace std;
 using namespace xylib::util;
+using boost::int16_t;
+using boost::uint16_t;
+using boost::uint32_t;
 
 namespace xylib {
 
@@ -62,6 +66,18 @@ struct spe_calib {
 };
 
 
+// read n values stored as type T (returned by read_fn as type R)
+template<typename T, typename R>
+static Column* read_values(istream &f, int n, R (*read_fn)(istream&))
+{
+    vector<T> values(n);
+    for (int i = 0; i < n; ++i)
+        values[i] = static_cast<T>((*read_fn)(f));
+    // frames usually contain counts, which are stored compactly if possible
+    return make_count_column(values);
+}
+
+
 bool WinspecSpeDataSet::check(istream &f, string*) {
     // make sure file size > 4100 (data begins after a 4100-byte header)
     f.seekg(-1, ios_base::end);
@@ -111,42 +127,50 @@ void WinspecSpeDataSet::load_data(std::istream &f)
     }
 
     f.ignore(122);      // move ptr to frames-start
+    // all frames have the same x axis, the column is shared by blocks
+    const Block *first_blk = NULL;
     for (unsigned frm = 0; frm < num_frames; ++frm) {
         Block *blk = new Block;
-        Column *xcol = get_calib_column(calib, dim);
-        blk->add_column(xcol);
-
-        VecColumn *ycol = new VecColumn;
-        for (int i = 0; i < dim; ++i) {
-            double y = 0;
-            switch (data_type) {
-                case SPE_DATA_FLOAT:
-                    y = read_flt_le(f);
-                    break;
-                case SPE_DATA_LONG:
-                    y = read_uint32_le(f);
-                    break;
-                case SPE_DATA_INT:
-                    y = read_int16_le(f);
-                    break;
-                case SPE_DATA_UINT:
-                    y = read_uint16_le(f);
-                    break;
-                default:
-                    break;
+        if (first_blk == NULL)
+            blk->add_column(get_calib_column(calib, dim));
+        else
+            blk->add_shared_column(first_blk, 1);
+
+        Column *ycol = NULL;
+        switch (data_type) {
+            case SPE_DATA_FLOAT:
+                ycol = read_values<float>(f, dim, read_flt_le);
+                break;
+            case SPE_DATA_LONG:
+                ycol = read_values<uint32_t>(f, dim, read_uint32_le);
+                break;
+            case SPE_DATA_INT:
+                ycol = read_values<int16_t>(f, dim, read_int16_le);
+                break;
+            case SPE_DATA_UINT:
+                ycol = read_values<uint16_t>(f, dim, read_uint16_le);
+                break;
+            default: {
+                VecColumn *zeros = new VecColumn;
+                for (int i = 0; i < dim; ++i)
+                    zeros->add_val(0.);
+                ycol = zeros;
+                break;
             }
-            ycol->add_val(y);
         }
         blk->add_column(ycol);
 
         add_block(blk);
+        if (first_blk == NULL)
+            first_blk = blk;
     }
 }
 
 
 Column* WinspecSpeDataSet::get_calib_column(const spe_calib *calib, int dim)
 {
-    format_assert(this, calib->polynom_order < 6, "bad polynom header");
+    format_assert(this, calib->polynom_order >= 0 && calib->polynom_order < 6,
+                  "bad polynom header");
 
     if (!calib->calib_valid)    //use idx as X instead
         return new StepColumn(0, 1);
@@ -154,16 +178,9 @@ Column* WinspecSpeDataSet::get_calib_column(const spe_calib *calib, int dim)
         return new StepColumn(calib->polynom_coeff[0],
                               calib->polynom_coeff[1]);
     }
-    else {
-        VecColumn *xcol = new VecColumn;
-        for (int i = 0; i < dim; ++i) {
-            double x = 0;
-            for (int j = 0; j <= calib->polynom_order; ++j)
-                x += calib->polynom_coeff[j] * pow(i + 1., double(j));
-            xcol->add_val(x);
-        }
-        return xcol;
-    }
+    else // pixels are numbered from 1
+        return new PolyColumn(calib->polynom_coeff, calib->polynom_order + 1,
+                              1., dim);
 }
 
 
@@ -46,6 +46,8 @@ void XsygDataSet::load_data(std::istream &f){
 
     ptree tree;
     unsigned int measurement_nr, AQ_nr = 1;
+    // the last blocks with curves and spectra, for sharing x-axes
+    const Block *prev_curve_blk = NULL, *prev_spectrum_blk = NULL;
     
     //read XML file
     read_xml(f, tree);
@@ -177,12 +179,20 @@ void XsygDataSet::load_data(std::istream &f){
                     blk->set_name("AQ: " + convert_AQ.str() + ", Meas.: " +
                             convert_measurement_nr.str() + ", Type: " + recordType + " (" + detector +")");
 
-                    // add column to block
-                    blk->add_column(x_axis_col);
+                    // add column to block, the x-axis is shared with
+                    // the previous curve if it's the same
+                    if (prev_curve_blk != NULL &&
+                            columns_equal(prev_curve_blk->get_column(1), *x_axis_col)) {
+                        delete x_axis_col;
+                        blk->add_shared_column(prev_curve_blk, 1);
+                    } else {
+                        blk->add_column(x_axis_col);
+                    }
                     blk->add_column(y_axis_col);
 
                     //finally: add block
                     add_block(blk);
+                    prev_curve_blk = blk;
 
                     } else {	// end if not spectrometer
 
@@ -201,7 +211,22 @@ void XsygDataSet::load_data(std::istream &f){
                         x_axis_col-> add_values_from_str(wavelength_split);
                     }
 
-                    blk->add_column(x_axis_col);
+                    //get curveDescripter
+                    string curveDescriptor = j -> second.get("<xmlattr>.curveDescripter","");
+                    std::vector<std::string> curve_descriptor_split;
+                    boost::split(curve_descriptor_split, curveDescriptor, boost::is_any_of(";"));
+
+                    //set names of columns
+                    x_axis_col-> set_name(curve_descriptor_split[1]);
+
+                    //share the axis with the previous spectrum if it's the same
+                    if (prev_spectrum_blk != NULL &&
+                            columns_equal(prev_spectrum_blk->get_column(1), *x_axis_col)) {
+                        delete x_axis_col;
+                        blk->add_shared_column(prev_spectrum_blk, 1);
+                    } else {
+                        blk->add_column(x_axis_col);
+                    }
 
                     //read counts
                     std::string intens = j->second.data();
@@ -244,14 +269,6 @@ void XsygDataSet::load_data(std::istream &f){
                         } // end while 2
                     } // end while 1
 
-                    //get curveDescripter
-                    string curveDescriptor = j -> second.get("<xmlattr>.curveDescripter","");
-                    std::vector<std::string> curve_descriptor_split;
-                    boost::split(curve_descriptor_split, curveDescriptor, boost::is_any_of(";"));
-
-                    //set names of columns
-                    x_axis_col-> set_name(curve_descriptor_split[1]);
-
                     string recordType = i -> second.get("<xmlattr>.recordType","");
                     string state = j -> second.get("<xmlattr>.state","");
                     string parentID = j-> second.get("<xmlattr>.state","");
@@ -297,6 +314,7 @@ void XsygDataSet::load_data(std::istream &f){
 
                     //finally: add block
                     add_block(blk);
+                    prev_spectrum_blk = blk;
 
                     } // end if Spectrometer
                 } // end if detector != ""
@@ -9,9 +9,12 @@
 #include <climits>  // for INT_MAX
 #include <iomanip>
 #include <algorithm>
+#include <new>      // placement new
 #include <sstream>  // for istringstream
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/alignment_of.hpp>
 
 #if HAVE_CONFIG_H
 #  include <config.h>
@@ -25,6 +28,18 @@
 #  include <bzlib.h>
 #endif
 
+#ifdef HAVE_LIBLZMA
+#  include <lzma.h>
+#endif
+
+#ifdef HAVE_LIBZSTD
+#  include <zstd.h>
+#endif
+
+#ifdef HAVE_LIBLZ4
+#  include <lz4frame.h>
+#endif
+
 #include "util.h"
 #include "bruker_raw.h"
 #include "bruker_spc.h"
@@ -51,12 +66,25 @@
 
 #include <vector>
 #include <map>
+#include <set>
+#if XYLIB_USE_STD_MUTEX
+# include <condition_variable>
+# include <deque>
+# include <exception>
+# include <mutex>
+# include <system_error>
+# include <thread>
+#endif
 #ifdef _WIN32
 # define WIN32_LEAN_AND_MEAN
-# include <windows.h> // MultiByteToWideChar
+# include <windows.h> // MultiByteToWideChar, MapViewOfFile
 # if defined(__GLIBCXX__)
 #  include <ext/stdio_filebuf.h> // __gnu_cxx::stdio_filebuf
 # endif
+#elif defined(HAVE_MMAP)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
 #endif
 
 using namespace std;
@@ -136,6 +164,19 @@ void* xylib_load_file(const char* path, const char* format_name,
     }
 }
 
+void* xylib_load_memory(const void* data, size_t size,
+                        const char* format_name, const char* options)
+{
+    try {
+        return (void*) load_memory(data, size,
+                                   format_name != NULL ? format_name : "",
+                                   options != NULL ? options : "");
+    }
+    catch (std::exception&) {
+        return NULL;
+    }
+}
+
 void* xylib_get_block(void* dataset, int block)
 {
     try {
@@ -148,19 +189,87 @@ void* xylib_get_block(void* dataset, int block)
 
 int xylib_count_columns(void* block)
 {
-    return ((Block*) block)->get_column_count();
+    return ((const Block*) block)->get_column_count();
 }
 
 int xylib_count_rows(void* block, int column)
 {
     if (column < 0 || column > xylib_count_columns(block))
         return 0;
-    return ((Block*) block)->get_column(column).get_point_count();
+    return ((const Block*) block)->get_column(column).get_point_count();
 }
 
 double xylib_get_data(void* block, int column, int row)
 {
-    return ((Block*) block)->get_column(column).get_value(row);
+    return ((const Block*) block)->get_column(column).get_value(row);
+}
+
+xylib_index_t xylib_count_rows64(void* block, int column)
+{
+    if (column < 0 || column > xylib_count_columns(block))
+        return 0;
+    return ((const Block*) block)->get_column(column).get_point_count64();
+}
+
+double xylib_get_data64(void* block, int column, xylib_index_t row)
+{
+    return ((const Block*) block)->get_column(column).get_value64(row);
+}
+
+int xylib_get_values64(void* block, int column, xylib_index_t first,
+                       xylib_index_t count, double* out)
+{
+    try {
+        const Block* b = (const Block*) block;
+        b->get_column(column).get_values64(first, count, out);
+        return 0;
+    }
+    catch (RunTimeError&) {
+        return -1;
+    }
+}
+
+int xylib_get_values(void* block, int column, int first, int count,
+                     double* out)
+{
+    try {
+        const Block* b = (const Block*) block;
+        b->get_column(column).get_values(first, count, out);
+        return 0;
+    }
+    catch (RunTimeError&) {
+        return -1;
+    }
+}
+
+void* xylib_release_values(void* block, int column)
+{
+    try {
+        vector<double> values;
+        ((Block*) block)->release_values(column, values);
+        vector<double>* buf = new vector<double>;
+        buf->swap(values);
+        return buf;
+    }
+    catch (RunTimeError&) {
+        return NULL;
+    }
+}
+
+xylib_index_t xylib_buffer_size(void* buffer)
+{
+    return (xylib_index_t) ((vector<double>*) buffer)->size();
+}
+
+const double* xylib_buffer_data(void* buffer)
+{
+    vector<double>* buf = (vector<double>*) buffer;
+    return buf->empty() ? NULL : &(*buf)[0];
+}
+
+void xylib_free_buffer(void* buffer)
+{
+    delete (vector<double>*) buffer;
 }
 
 const char* xylib_dataset_metadata(void* dataset, const char* key)
@@ -176,7 +285,7 @@ const char* xylib_dataset_metadata(void* dataset, const char* key)
 const char* xylib_block_metadata(void* block, const char* key)
 {
     try {
-        return ((Block*) block)->meta.get(key).c_str();
+        return ((const Block*) block)->meta.get(key).c_str();
     }
     catch (RunTimeError&) {
         return NULL;
@@ -212,129 +321,544 @@ bool check_format(FormatInfo const* fi, std::istream& f, string* details)
     return !fi->checker || (*fi->checker)(f, details);
 }
 
-struct MetaDataImp : public map<string, string>
+void* Column::operator new(size_t size)
+{
+    return arena_new(size);
+}
+
+void Column::operator delete(void* ptr)
 {
+    arena_delete(ptr);
+}
+
+ColumnView Column::get_view() const
+{
+    ColumnView v;
+    v.kind = kind_;
+    v.count = get_point_count();
+    v.data = (kind_ == kColumnArray ? get_data_pointer() : NULL);
+    v.start = (kind_ == kColumnStep && v.count != 0 ? get_value(0) : 0.);
+    v.step = get_step();
+    v.column = this;
+    return v;
+}
+
+namespace {
+
+// number of leading points in view v for which cmp(value, x) is true;
+// cmp must be true for a prefix of the points and false for the rest
+int count_leading(ColumnView const& v, int n, double x,
+                  bool (*cmp)(double, double))
+{
+    int left = 0, right = n;
+    while (left < right) {
+        int mid = left + (right - left) / 2;
+        if (cmp(v[mid], x))
+            left = mid + 1;
+        else
+            right = mid;
+    }
+    return left;
+}
+
+bool lt(double a, double b) { return a < b; }
+bool le(double a, double b) { return a <= b; }
+bool gt(double a, double b) { return a > b; }
+bool ge(double a, double b) { return a >= b; }
+
+} // anonymous namespace
+
+pair<int,int> Column::find_range(double lo, double hi, int point_count) const
+{
+    int n = get_point_count();
+    if (n == -1)
+        n = point_count;
+    if (n <= 0 || lo > hi)
+        return make_pair(0, 0);
+    ColumnStats st = get_stats(n); // cached in columns that store data
+    if (st.nan_count == 0 && st.monotonic != 0) {
+        ColumnView v = get_view();
+        int first, last;
+        if (st.monotonic > 0) {
+            first = count_leading(v, n, lo, lt);
+            last = count_leading(v, n, hi, le);
+        } else {
+            first = count_leading(v, n, hi, gt);
+            last = count_leading(v, n, lo, ge);
+        }
+        return make_pair(first, max(first, last));
+    }
+    // scan all points
+    int first = n, last = 0;
+    double buf[512];
+    for (int i = 0; i < n; i += 512) {
+        int count = min(512, n - i);
+        get_values(i, count, buf);
+        for (int j = 0; j < count; ++j)
+            if (in_range(buf[j], lo, hi)) {
+                if (first == n)
+                    first = i + j;
+                last = i + j + 1;
+            }
+    }
+    return first < last ? make_pair(first, last) : make_pair(0, 0);
+}
+
+ColumnStats Column::get_stats(int point_count) const
+{
+    xylib_index_t n = get_point_count64();
+    if (n == -1)
+        n = point_count;
+    StatsAccumulator acc;
+    const double* ptr = get_data_pointer();
+    if (ptr != NULL)
+        acc.add(ptr, n);
+    else {
+        double buf[512];
+        for (xylib_index_t i = 0; i < n; i += 512) {
+            xylib_index_t count = std::min((xylib_index_t) 512, n - i);
+            get_values64(i, count, buf);
+            acc.add(buf, count);
+        }
+    }
+    return acc.get();
+}
+
+void Column::get_values(int first, int count, double* out) const
+{
+    for (int i = 0; i < count; ++i)
+        out[i] = get_value(first + i);
+}
+
+double Column::get_value64(xylib_index_t n) const
+{
+    if (n > INT_MAX)
+        throw RunTimeError("point index out of range");
+    return get_value((int) n);
+}
+
+void Column::get_values64(xylib_index_t first, xylib_index_t count,
+                          double* out) const
+{
+    if (count <= 0)
+        return;
+    if (first + count > INT_MAX)
+        throw RunTimeError("point index out of range");
+    get_values((int) first, (int) count, out);
+}
+
+namespace {
+
+typedef boost::shared_ptr<const string> Key;
+
+bool key_ptr_less(Key const& a, string const& b) { return *a < b; }
+
+// Keys of metadata of one dataset. The same keys are repeated in every
+// block, so each of them is stored once and shared by the items.
+class KeyTable
+{
+public:
+    Key intern(string const& key)
+    {
+        vector<Key>::iterator i = std::lower_bound(keys_.begin(), keys_.end(),
+                                                   key, key_ptr_less);
+        if (i == keys_.end() || **i != key)
+            i = keys_.insert(i, Key(new string(key)));
+        return *i;
+    }
+    size_t memory_bytes() const { return keys_.capacity() * sizeof(Key); }
+
+private:
+    vector<Key> keys_;
+};
+
+// key table of the dataset being loaded in this thread
+XYLIB_THREAD_LOCAL KeyTable* current_key_table = NULL;
+
+// Sets current key table for the lifetime of the object.
+class KeyTableScope
+{
+public:
+    explicit KeyTableScope(KeyTable* table) : prev_(current_key_table)
+        { current_key_table = table; }
+    ~KeyTableScope() { current_key_table = prev_; }
+private:
+    KeyTable* prev_;
+};
+
+Key make_key(string const& key)
+{
+    if (current_key_table != NULL)
+        return current_key_table->intern(key);
+    return Key(new string(key));
+}
+
+} // anonymous namespace
+
+// Key-value pairs are kept sorted by key in a vector. Metadata is usually
+// filled once and then iterated, so it's faster and more compact than a map.
+// Keys are shared through the key table of the dataset (see KeyTable).
+// The vector is shared by copies of MetaData until one of them is modified
+// (copy-on-write); empty MetaData doesn't allocate it at all.
+struct MetaDataImp
+{
+    typedef pair<Key, string> Item;
+    typedef vector<Item> Items;
+    boost::shared_ptr<Items> items_ptr;
+
+    Items const& items() const
+    {
+        static const Items empty;
+        return items_ptr ? *items_ptr : empty;
+    }
+
+    // must be used for any modification
+    Items& mutable_items()
+    {
+        if (!items_ptr)
+            items_ptr.reset(new Items);
+        else if (!items_ptr.unique())
+            items_ptr.reset(new Items(*items_ptr));
+        return *items_ptr;
+    }
+
+    static bool key_less(Item const& item, string const& key)
+    {
+        return *item.first < key;
+    }
+
+    Items::iterator mutable_lower_bound(string const& key)
+    {
+        Items& v = mutable_items();
+        return std::lower_bound(v.begin(), v.end(), key, key_less);
+    }
+
+    // returns NULL if not found
+    Item const* find(string const& key) const
+    {
+        Items const& v = items();
+        Items::const_iterator i =
+                        std::lower_bound(v.begin(), v.end(), key, key_less);
+        return i != v.end() && *i->first == key ? &*i : NULL;
+    }
 };
 
 MetaData::MetaData()
-    : imp_(new MetaDataImp)
 {
+    new (imp_buf_) MetaDataImp;
+    BOOST_STATIC_ASSERT(sizeof(MetaDataImp) <= sizeof(imp_buf_));
+    BOOST_STATIC_ASSERT(boost::alignment_of<MetaDataImp>::value <=
+                        boost::alignment_of<void*>::value);
 }
 
 MetaData::~MetaData()
 {
-    delete imp_;
+    imp()->~MetaDataImp();
 }
 
 void MetaData::operator=(const MetaData& other)
 {
-    *imp_ = *other.imp_;
+    imp()->items_ptr = other.imp()->items_ptr;
 }
 
 bool MetaData::has_key(std::string const& key) const
 {
-    return imp_->find(key) != imp_->end();
+    return imp()->find(key) != NULL;
 }
 
 string const& MetaData::get(string const& key) const
 {
-    map<string,string>::const_iterator it = imp_->find(key);
-    if (it == imp_->end())
+    MetaDataImp::Item const* item = imp()->find(key);
+    if (item == NULL)
         throw RunTimeError("no such key in meta-info found");
-    return it->second;
+    return item->second;
 }
 
 bool MetaData::set(string const& key, string const& val)
 {
-    //map::insert returns pair<iterator,bool>
-    return imp_->insert(make_pair(key, val)).second;
+    if (imp()->find(key) != NULL)
+        return false;
+    MetaDataImp::Items::iterator i = imp()->mutable_lower_bound(key);
+    imp()->items_ptr->insert(i, make_pair(make_key(key), val));
+    return true;
 }
 
 size_t MetaData::size() const
 {
-    return imp_->size();
+    return imp()->items().size();
+}
+
+size_t MetaData::memory_bytes() const
+{
+    MetaDataImp::Items const& items = imp()->items();
+    size_t n = sizeof(MetaData);
+    if (imp()->items_ptr)
+        n += sizeof(MetaDataImp::Items)
+             + items.capacity() * sizeof(MetaDataImp::Item);
+    for (MetaDataImp::Items::const_iterator i = items.begin();
+                                                    i != items.end(); ++i)
+        n += (sizeof(string) + string_heap_bytes(*i->first))
+                                                    / i->first.use_count()
+             + string_heap_bytes(i->second);
+    return n;
 }
 
 string const& MetaData::get_key(size_t index) const
 {
-    map<string,string>::const_iterator it = imp_->begin();
-    for (size_t i = 0; i < index; ++i)
-        ++it;
-    return it->first;
+    return *imp()->items()[index].first;
+}
+
+string const& MetaData::get_value(size_t index) const
+{
+    return imp()->items()[index].second;
 }
 
 void MetaData::clear()
 {
-    imp_->clear();
+    imp()->items_ptr.reset();
 }
 
 string& MetaData::operator[] (string const& x)
 {
-    return (*imp_)[x];
+    MetaDataImp::Items::iterator i = imp()->mutable_lower_bound(x);
+    if (i == imp()->items_ptr->end() || *i->first != x)
+        i = imp()->items_ptr->insert(i, make_pair(make_key(x), string()));
+    return i->second;
 }
 
 
 Column* const Block::index_column = new StepColumn(0, 1);
 
+// Columns are shared by blocks copied with Block::clone().
 struct BlockImp
 {
+    typedef vector<boost::shared_ptr<Column> > Columns;
     string name;
-    vector<Column*> cols;
+    Columns cols;
+};
+
+namespace {
+
+// deleter of columns in BlockImp, allows to take a column back
+// from shared_ptr (see Block::del_column()); a column from an arena
+// is deleted with its arena set as current (see arena_delete())
+struct ColumnDeleter
+{
+    bool released;
+    Arena* arena;
+    explicit ColumnDeleter(Arena* a) : released(false), arena(a) {}
+    void operator()(Column* c) const
+    {
+        if (released)
+            return;
+        ArenaScope arena_scope(arena);
+        delete c;
+    }
 };
 
+boost::shared_ptr<Column> make_column_ptr(Column* c)
+{
+    Arena* arena = get_current_arena();
+    if (arena != NULL && !arena->owns(c))
+        arena = NULL;
+    return boost::shared_ptr<Column>(c, ColumnDeleter(arena));
+}
+
+} // anonymous namespace
+
+void* Block::operator new(size_t size)
+{
+    return arena_new(size);
+}
+
+void Block::operator delete(void* ptr)
+{
+    arena_delete(ptr);
+}
+
 Block::Block()
-    : imp_(new BlockImp)
 {
+    new (imp_buf_) BlockImp;
+    BOOST_STATIC_ASSERT(sizeof(BlockImp) <= sizeof(imp_buf_));
+    BOOST_STATIC_ASSERT(boost::alignment_of<BlockImp>::value <=
+                        boost::alignment_of<void*>::value);
 }
 
 Block::~Block()
 {
-    purge_all_elements(imp_->cols);
-    delete imp_;
+    imp()->~BlockImp();
 }
 
 std::string const& Block::get_name() const
 {
-    return imp_->name;
+    return imp()->name;
 }
 
 void Block::set_name(std::string const& name)
 {
-    imp_->name = name;
+    imp()->name = name;
 }
 
 int Block::get_column_count() const
 {
-    return (int) imp_->cols.size();
+    return (int) imp()->cols.size();
 }
 
 const Column& Block::get_column(int n) const
 {
     if (n == 0)
         return *index_column;
-    int c = (n < 0 ? n + (int) imp_->cols.size() : n - 1);
-    if (c < 0 || c >= (int) imp_->cols.size())
+    int c = (n < 0 ? n + (int) imp()->cols.size() : n - 1);
+    if (c < 0 || c >= (int) imp()->cols.size())
         throw RunTimeError("column index out of range: " + S(n));
-    return *imp_->cols[c];
+    return *imp()->cols[c];
 }
 
 void Block::add_column(Column* c, bool append)
 {
-    imp_->cols.insert((append ? imp_->cols.end() : imp_->cols.begin()), c);
+    imp()->cols.insert((append ? imp()->cols.end() : imp()->cols.begin()),
+                      make_column_ptr(c));
+}
+
+void Block::add_shared_column(const Block* other, int n, bool append)
+{
+    if (n == 0)
+        throw RunTimeError("index column can't be shared");
+    other->get_column(n); // check n
+    int c = (n < 0 ? n + (int) other->imp()->cols.size() : n - 1);
+    imp()->cols.insert((append ? imp()->cols.end() : imp()->cols.begin()),
+                      other->imp()->cols[c]);
 }
 
 Column* Block::del_column(int n)
 {
-    Column *c = imp_->cols[n];
-    imp_->cols.erase(imp_->cols.begin() + n);
-    return c;
+    boost::shared_ptr<Column> ptr = imp()->cols[n];
+    imp()->cols.erase(imp()->cols.begin() + n);
+    ColumnDeleter* deleter = boost::get_deleter<ColumnDeleter>(ptr);
+    // the caller can delete a column from an arena only while it's current
+    if (!ptr.unique() ||
+            (deleter->arena != NULL && deleter->arena != get_current_arena()))
+        return new SharedColumn(ptr);
+    deleter->released = true;
+    return ptr.get();
+}
+
+void Block::release_values(int n, vector<double>& out)
+{
+    const Column& col = get_column(n); // checks n
+    out.clear();
+    if (n == 0 || col.get_point_count64() < 0)
+        return;
+    boost::shared_ptr<Column>& ptr =
+                    imp()->cols[n < 0 ? n + (int) imp()->cols.size() : n - 1];
+    if (ptr.unique() && ptr->release_data(out))
+        return;
+    out.resize(col.get_point_count64());
+    if (!out.empty())
+        col.get_values64(0, (xylib_index_t) out.size(), &out[0]);
+    // other blocks that share the column still use it
+    VecColumn* empty = new VecColumn;
+    empty->set_name(col.get_name());
+    ptr = make_column_ptr(empty);
+}
+
+Block* Block::clone() const
+{
+    Block* block = new Block;
+    block->meta = meta;
+    block->imp()->name = imp()->name;
+    block->imp()->cols = imp()->cols;
+    return block;
+}
+
+pair<int,int> Block::find_range(int n, double lo, double hi) const
+{
+    int count = get_point_count();
+    const Column& col = get_column(n);
+    // points of a column that is longer than the block are not searched
+    if (n != 0 && count != -1 && col.get_point_count() > count) {
+        SliceColumn view(imp()->cols[n < 0 ? n + (int) imp()->cols.size()
+                                          : n - 1], 0, count);
+        return view.find_range(lo, hi);
+    }
+    return col.find_range(lo, hi, count == -1 ? 0 : count);
+}
+
+size_t Block::own_memory_bytes() const
+{
+    // meta is a member, so sizeof(MetaData) is counted in meta.memory_bytes()
+    return sizeof(Block) - sizeof(MetaData) + meta.memory_bytes()
+           + string_heap_bytes(imp()->name)
+           + imp()->cols.capacity() * sizeof(imp()->cols[0]);
+}
+
+namespace {
+// adds memory of columns of the block that are not in counted yet
+size_t add_columns_memory(const Block* block, set<const Column*>& counted)
+{
+    size_t n = 0;
+    for (int i = 1; i <= block->get_column_count(); ++i) {
+        const Column* col = &block->get_column(i);
+        if (counted.insert(col).second)
+            n += col->memory_bytes();
+    }
+    return n;
+}
+} // anonymous namespace
+
+size_t Block::memory_bytes() const
+{
+    set<const Column*> counted;
+    return own_memory_bytes() + add_columns_memory(this, counted);
+}
+
+Block* Block::make_slice(int first, int last) const
+{
+    int n = get_point_count();
+    if (first < 0 || first > last || (n != -1 && last > n))
+        throw RunTimeError("slice out of range: " + S(first) + ":" + S(last));
+    Block* block = new Block;
+    block->meta = meta;
+    block->set_name(get_name());
+    for (BlockImp::Columns::const_iterator i = imp()->cols.begin();
+                                                i != imp()->cols.end(); ++i)
+        block->add_column(new SliceColumn(*i, first, last - first));
+    return block;
+}
+
+// Free unused capacity of all columns, loaded datasets are often kept
+// in memory for a long time. Statistics cached in columns are computed now,
+// so that later the columns can be read (and shared, see DataSet::clone())
+// by many threads without modifying them. It's called before the dataset
+// is returned by load_stream_of_format(), when columns can be shared only
+// by blocks of this dataset (Block::add_shared_column()); neither
+// shrink_to_fit() nor get_stats() changes values.
+void Block::finalize_columns()
+{
+    for (BlockImp::Columns::iterator i = imp()->cols.begin();
+                                                i != imp()->cols.end(); ++i) {
+        (*i)->shrink_to_fit();
+        (*i)->get_stats();
+    }
+}
+
+xylib_index_t Block::get_point_count64() const
+{
+    xylib_index_t min_n = -1;
+    for (BlockImp::Columns::const_iterator i = imp()->cols.begin();
+                                                i != imp()->cols.end(); ++i) {
+        xylib_index_t n = (*i)->get_point_count64();
+        if (min_n == -1 || (n != -1 && n < min_n))
+            min_n = n;
+    }
+    return min_n;
 }
 
 int Block::get_point_count() const
 {
     int min_n = -1;
-    for (vector<Column*>::const_iterator i = imp_->cols.begin();
-                                                i != imp_->cols.end(); ++i) {
+    for (BlockImp::Columns::const_iterator i = imp()->cols.begin();
+                                                i != imp()->cols.end(); ++i) {
         int n = (*i)->get_point_count();
         if (min_n == -1 || (n != -1 && n < min_n))
             min_n = n;
@@ -342,15 +866,34 @@ int Block::get_point_count() const
     return min_n;
 }
 
+namespace {
+// settings from set_arena_allocation()
+XYLIB_THREAD_LOCAL bool arena_enabled = false;
+XYLIB_THREAD_LOCAL Allocator* arena_allocator = NULL;
+}
+
+void set_arena_allocation(bool enabled, Allocator* allocator)
+{
+    arena_enabled = enabled;
+    arena_allocator = allocator;
+}
+
 struct DataSetImp
 {
     std::vector<Block*> blocks;
     std::string options;
+    // empty if arena allocation is not used; shared with clones,
+    // because their columns can be allocated in the arena
+    boost::shared_ptr<Arena> arena;
+    // used while loading; clones share the keys with items, not the table
+    KeyTable keys;
 };
 
 DataSet::DataSet(FormatInfo const* fi_)
     : fi(fi_), imp_(new DataSetImp)
 {
+    if (arena_enabled)
+        imp_->arena.reset(new Arena(arena_allocator));
 }
 
 DataSet::~DataSet()
@@ -371,9 +914,57 @@ const Block* DataSet::get_block(int n) const
     return imp_->blocks[n];
 }
 
+Block* DataSet::get_block(int n)
+{
+    return const_cast<Block*>(static_cast<const DataSet*>(this)->get_block(n));
+}
+
+size_t DataSet::memory_bytes() const
+{
+    size_t n = sizeof(DataSet) - sizeof(MetaData) + meta.memory_bytes()
+               + sizeof(DataSetImp) + string_heap_bytes(imp_->options)
+               + imp_->keys.memory_bytes()
+               + imp_->blocks.capacity() * sizeof(Block*);
+    // columns shared by blocks are counted once
+    set<const Column*> counted;
+    for (vector<Block*>::const_iterator i = imp_->blocks.begin();
+                                                i != imp_->blocks.end(); ++i)
+        n += (*i)->own_memory_bytes() + add_columns_memory(*i, counted);
+    if (imp_->arena)
+        n += sizeof(Arena) + imp_->arena->unused_bytes();
+    return n;
+}
+
+// the arena is shared, not created, because columns can be allocated in it
+DataSet::DataSet(const DataSet& other)
+    : fi(other.fi), imp_(new DataSetImp)
+{
+    meta = other.meta;
+    imp_->options = other.imp_->options;
+    imp_->arena = other.imp_->arena;
+    imp_->blocks.reserve(other.imp_->blocks.size());
+    try {
+        for (vector<Block*>::const_iterator i = other.imp_->blocks.begin();
+                                        i != other.imp_->blocks.end(); ++i)
+            imp_->blocks.push_back((*i)->clone());
+    } catch (...) {
+        purge_all_elements(imp_->blocks);
+        delete imp_;
+        throw;
+    }
+}
+
+// the object of the derived class is copied, with its members
+DataSet* DataSet::clone() const
+{
+    return make_copy();
+}
+
 // clear all the data of this dataset
 void DataSet::clear()
 {
+    // blocks and columns from the arena are deleted only when it's current
+    ArenaScope arena_scope(imp_->arena.get());
     purge_all_elements(imp_->blocks);
     meta.clear();
 }
@@ -417,100 +1008,946 @@ DataSet* load_stream_of_format(istream &is, FormatInfo const* fi,
         throw FormatError("The file is empty.");
 
     DataSet *ds = (*fi->ctor)();
-    ds->set_options(options);
     try {
+        ds->set_options(options);
+        ArenaScope arena_scope(ds->imp_->arena.get());
+        KeyTableScope key_scope(&ds->imp_->keys);
         ds->load_data(is);
+        for (int i = 0; i != ds->get_block_count(); ++i)
+            ds->get_block(i)->finalize_columns();
     }
     catch (FormatError &e) {
+        delete ds;
         throw FormatError(string(e.what()) + " [filetype: " + fi->name + "]");
     }
+    catch (...) {
+        delete ds;
+        throw;
+    }
     return ds;
 }
 
 
-// One pass input streambuf. It reads and decompress whole file in ctor.
-struct decompressing_istreambuf : public std::streambuf
+// Input streambuf that decompresses a file while it is being read.
+// Only a window of decompressed data is kept: the current chunk and the end
+// of the previous one (for short backward seeks). Seeking to a position
+// before the window restarts decompression from the beginning of the file
+// (guess_filetype() rewinds the stream, but usually it is still within
+// the first chunk). Seeking relative to the end decompresses the file once
+// to find its size. With C++11 the next chunks are decompressed in
+// a background thread while the current one is parsed.
+class decompressing_istreambuf : public std::streambuf
 {
-    decompressing_istreambuf() { init_buf(); }
+public:
+    virtual ~decompressing_istreambuf() {}
 
-    void init_buf()
+protected:
+    decompressing_istreambuf()
+        : window_(kKeep + kChunk), window_pos_(0), size_(-1), at_end_(false)
+#if XYLIB_USE_STD_MUTEX
+          , started_(false), stop_(false)
+#endif
     {
-        bufavail_ = 2048;
-        bufdata_ = (char*) malloc(bufavail_);
-        writeptr_ = bufdata_;
+        setg(&window_[0], &window_[0], &window_[0]);
     }
 
-    // should be called only when the buffer is full, double the buffer size
-    void double_buf()
+    // Reads up to size bytes of decompressed data. Less is returned only
+    // at the end of the file. Throws RunTimeError if the data is corrupted.
+    virtual int read_raw(char* buf, int size) = 0;
+    // starts decompression from the beginning of the file
+    virtual bool rewind_raw() = 0;
+    // must be called in destructors of derived classes, because the
+    // background thread calls read_raw()
+    void stop_reading()
     {
-        int old_size = (int) (writeptr_ - bufdata_);
-        if (old_size > INT_MAX / 2) {
-            // bufdata_ will be freed in dtor
-            throw RunTimeError("We ignore very big (1GB+ uncompressed) files");
+#if XYLIB_USE_STD_MUTEX
+        if (!started_)
+            return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
         }
-        bufdata_ = (char*) realloc(bufdata_, 2 * old_size);
-        if (!bufdata_) {
-            bufdata_ = writeptr_ - old_size; // will be freed in dtor
-            throw RunTimeError("Can't allocate memory (" + S(2*old_size)
-                    + " bytes).");
+        cond_.notify_all();
+        thread_.join();
+        started_ = false;
+        stop_ = false;
+        chunks_.clear();
+        error_ = std::exception_ptr();
+#endif
+    }
+
+    virtual int_type underflow()
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+        if (at_end_)
+            return traits_type::eof();
+        // keep the end of the current chunk before the new one
+        char* begin = &window_[0];
+        size_t keep = std::min((size_t) (egptr() - eback()), (size_t) kKeep);
+        memmove(begin, egptr() - keep, keep);
+        window_pos_ += (egptr() - eback()) - keep;
+        int n = fetch(begin + keep);
+        setg(begin, begin + keep, begin + keep + n);
+        if (n < (int) kChunk) {
+            at_end_ = true;
+            size_ = window_pos_ + keep + n;
         }
-        // bufdata_ can be changed
-        writeptr_ = bufdata_ + old_size;
-        bufavail_ = old_size;
+        if (n == 0)
+            return traits_type::eof();
+        return traits_type::to_int_type(*gptr());
     }
 
-    virtual streampos seekpos (streampos sp, ios_base::openmode which)
+    virtual pos_type seekoff(off_type off, ios_base::seekdir dir,
+                             ios_base::openmode which)
     {
-        if ((which & ios_base::in) && sp >= 0 &&  sp < writeptr_ - bufdata_) {
-            setg(bufdata_, bufdata_+(int)sp, writeptr_);
-            return sp;
+        off_type base = 0;
+        if (dir == ios_base::cur)
+            base = window_pos_ + (gptr() - eback());
+        else if (dir == ios_base::end) {
+            while (size_ < 0) {
+                setg(eback(), egptr(), egptr());
+                underflow();
+            }
+            base = size_;
         }
-        else
-            return -1;
+        return seekpos(pos_type(base + off), which);
     }
 
-    ~decompressing_istreambuf() { free(bufdata_); }
+    virtual pos_type seekpos(pos_type pos, ios_base::openmode which)
+    {
+        off_type p = pos;
+        if (!(which & ios_base::in) || p < 0)
+            return pos_type(off_type(-1));
+        if (p < window_pos_ && !restart())
+            return pos_type(off_type(-1));
+        while (p > window_pos_ + (egptr() - eback())) {
+            setg(eback(), egptr(), egptr());
+            if (traits_type::eq_int_type(underflow(), traits_type::eof()))
+                return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + (p - window_pos_), egptr());
+        return pos;
+    }
 
-protected:
-    int bufavail_;
-    char* bufdata_;
-    char* writeptr_;
+private:
+    static const size_t kChunk = 256 * 1024;
+    static const size_t kKeep = 4096;
+    std::vector<char> window_;
+    off_type window_pos_; // position of eback() in the decompressed file
+    off_type size_; // size of the decompressed file, -1 if not known yet
+    bool at_end_;
+
+    bool restart()
+    {
+        stop_reading();
+        if (!rewind_raw())
+            return false;
+        window_pos_ = 0;
+        at_end_ = false;
+        setg(&window_[0], &window_[0], &window_[0]);
+        return true;
+    }
+
+#if XYLIB_USE_STD_MUTEX
+    static const size_t kQueueLength = 2;
+    bool started_;
+    bool stop_;
+    std::deque<std::vector<char> > chunks_; // decompressed, not read yet
+    std::exception_ptr error_; // thrown in read_chunks(), after chunks_
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+
+    void read_chunks()
+    {
+        for (;;) {
+            std::vector<char> chunk;
+            int n = 0;
+            try {
+                chunk.resize(kChunk);
+                n = read_raw(&chunk[0], (int) kChunk);
+            } catch (...) {
+                // passed to fetch(), exceptions can't leave the thread
+                std::lock_guard<std::mutex> lock(mutex_);
+                error_ = std::current_exception();
+                cond_.notify_all();
+                return;
+            }
+            chunk.resize(n > 0 ? n : 0);
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_ && chunks_.size() >= kQueueLength)
+                cond_.wait(lock);
+            if (stop_)
+                return;
+            chunks_.push_back(std::vector<char>());
+            chunks_.back().swap(chunk);
+            cond_.notify_all();
+            if (n < (int) kChunk)
+                return;
+        }
+    }
+
+    int fetch(char* buf)
+    {
+        if (!started_) {
+            thread_ = std::thread(&decompressing_istreambuf::read_chunks,
+                                  this);
+            started_ = true;
+        }
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (chunks_.empty() && !error_)
+            cond_.wait(lock);
+        if (chunks_.empty())
+            std::rethrow_exception(error_);
+        int n = (int) chunks_.front().size();
+        if (n > 0)
+            memcpy(buf, &chunks_.front()[0], n);
+        chunks_.pop_front();
+        cond_.notify_all();
+        return n;
+    }
+#else
+    int fetch(char* buf) { return std::max(read_raw(buf, (int) kChunk), 0); }
+#endif
+};
+
+// Opened input file. The bytes read by detect_compression() from a file
+// that can't be rewound (pipe) are put back in front of it.
+class InputFile
+{
+public:
+    InputFile(FILE* f, bool seekable) : f_(f), seekable_(seekable), pos_(0) {}
+    ~InputFile() { fclose(f_); }
+
+    FILE* file() const { return f_; }
+    bool seekable() const { return seekable_; }
+    void unread(const char* data, size_t n)
+    {
+        prefix_.assign(data, data + n);
+        pos_ = 0;
+    }
+    // reads only the bytes that were put back by unread()
+    size_t read_prefix(char* buf, size_t n)
+    {
+        n = std::min(n, prefix_.size() - pos_);
+        if (n != 0)
+            memcpy(buf, &prefix_[pos_], n);
+        pos_ += n;
+        return n;
+    }
+    // like fread()
+    size_t read(char* buf, size_t n)
+    {
+        size_t k = read_prefix(buf, n);
+        if (k < n)
+            k += fread(buf + k, 1, n - k, f_);
+        return k;
+    }
+    bool error() const { return ferror(f_) != 0; }
+    // only seekable files can be read again
+    bool rewind()
+    {
+        prefix_.clear();
+        pos_ = 0;
+        return seekable_ && fseek(f_, 0, SEEK_SET) == 0;
+    }
+
+private:
+    FILE* f_;
+    bool seekable_;
+    std::vector<char> prefix_;
+    size_t pos_;
+
+    InputFile(const InputFile&); // disallow
+    void operator=(const InputFile&); // disallow
 };
 
 #ifdef HAVE_LIBZ
-struct gzip_istreambuf : public decompressing_istreambuf
+// BGZF files (made by bgzip) are series of independent gzip members
+// of up to 64kB, with the compressed size of each member in its header.
+// Members can be found without decompressing them, so a batch of members
+// is inflated in parallel (if compiled as C++11). From the first member
+// that is not a BGZF block (plain gzip file, or gzip files concatenated)
+// the rest of the file is inflated sequentially.
+class gzip_istreambuf : public decompressing_istreambuf
 {
-    explicit gzip_istreambuf(gzFile gz)
+public:
+    explicit gzip_istreambuf(InputFile& in)
+        : in_(in), out_pos_(0), eof_(false), n_threads_(1),
+          in_tail_(false), member_done_(false), tail_end_(false)
     {
-        for (;;) {
-            int n = gzread(gz, writeptr_, bufavail_);
-            writeptr_ += n;
-            if (n != bufavail_)
-                break;
-            double_buf();
+#if XYLIB_USE_STD_MUTEX
+        unsigned n = std::thread::hardware_concurrency();
+        if (n > 1)
+            n_threads_ = n;
+#endif
+    }
+    ~gzip_istreambuf()
+    {
+        stop_reading();
+        if (in_tail_)
+            inflateEnd(&zs_);
+    }
+
+protected:
+    int read_raw(char* buf, int size)
+    {
+        int total = 0;
+        while (total < size) {
+            if (out_pos_ == output_.size()) {
+                if (in_tail_) {
+                    total += inflate_tail(buf + total, size - total);
+                    break;
+                }
+                if (!inflate_batch())
+                    break;
+                continue;
+            }
+            size_t n = std::min(output_.size() - out_pos_,
+                                (size_t) (size - total));
+            memcpy(buf + total, &output_[out_pos_], n);
+            out_pos_ += n;
+            total += (int) n;
+        }
+        return total;
+    }
+
+    bool rewind_raw()
+    {
+        output_.clear();
+        out_pos_ = 0;
+        eof_ = false;
+        if (in_tail_)
+            inflateEnd(&zs_);
+        in_tail_ = false;
+        return in_.rewind();
+    }
+
+private:
+    struct Member
+    {
+        size_t in_pos, in_size; // in input_
+        size_t out_pos, out_size; // in output_
+        const char* error; // NULL if the member was inflated
+    };
+
+    // limits the memory used by a batch to 16MB (+ compressed data)
+    static const size_t kMaxBatch = 256;
+    static const size_t kTailChunk = 64 * 1024;
+
+    InputFile& in_;
+    std::vector<char> input_; // compressed members of the current batch
+    std::vector<Member> members_;
+    std::vector<char> output_; // decompressed current batch
+    size_t out_pos_;
+    bool eof_; // no more BGZF members
+    unsigned n_threads_;
+    // the part of the file after the last BGZF member
+    bool in_tail_; // set when zs_ is initialized for the tail
+    bool member_done_; // zs_ reached the end of a gzip member
+    bool tail_end_; // data after the last gzip member is ignored
+    z_stream zs_;
+    std::vector<char> tail_; // input of zs_
+
+    void fail(const char* msg) const
+    {
+        throw RunTimeError(string("error while reading .gz file: ") + msg);
+    }
+
+    // appends n bytes from the file to input_, returns false if the file
+    // ends before
+    bool read_input(size_t n)
+    {
+        size_t old_size = input_.size();
+        input_.resize(old_size + n);
+        size_t got = in_.read(&input_[old_size], n);
+        input_.resize(old_size + got);
+        return got == n;
+    }
+
+    // Appends the next member to input_ and members_. Returns false at
+    // the end of file or if the member is not a BGZF block; the bytes
+    // that were read are then left in input_ after the last member.
+    bool read_member()
+    {
+        size_t start = input_.size();
+        if (!read_input(12))
+            return false;
+        const unsigned char* h = (const unsigned char*) &input_[start];
+        if (h[0] != 0x1f || h[1] != 0x8b || (h[3] & 4) == 0)
+            return false;
+        size_t xlen = h[10] | (h[11] << 8);
+        if (xlen == 0 || !read_input(xlen))
+            return false;
+        // look for the BC subfield in the extra field
+        const unsigned char* x = (const unsigned char*) &input_[start+12];
+        size_t block_size = 0;
+        for (size_t i = 0; i + 4 <= xlen; ) {
+            size_t slen = x[i+2] | (x[i+3] << 8);
+            if (x[i] == 'B' && x[i+1] == 'C' && slen == 2 && i + 6 <= xlen)
+                block_size = (x[i+4] | (x[i+5] << 8)) + 1;
+            i += 4 + slen;
         }
-        setg(bufdata_, bufdata_, writeptr_);
+        // header + deflate data + CRC32 and ISIZE
+        if (block_size < 12 + xlen + 8 ||
+                !read_input(block_size - 12 - xlen))
+            return false;
+        const unsigned char* t =
+                        (const unsigned char*) &input_[start+block_size-4];
+        Member m;
+        m.in_pos = start;
+        m.in_size = block_size;
+        m.out_pos = 0;
+        m.out_size = t[0] | (t[1] << 8) | (t[2] << 16) | ((size_t) t[3] << 24);
+        m.error = NULL;
+        if (m.out_size > 65536)
+            return false;
+        members_.push_back(m);
+        return true;
+    }
+
+    // Reads and inflates the next batch of members to output_.
+    // Returns false if there is no more data.
+    bool inflate_batch()
+    {
+        input_.clear();
+        members_.clear();
+        output_.clear();
+        out_pos_ = 0;
+        size_t max_members = std::min((size_t) kMaxBatch,
+                                      (size_t) 8 * n_threads_);
+        while (!eof_ && members_.size() < max_members)
+            if (!read_member()) {
+                eof_ = true;
+                start_tail();
+            }
+        if (members_.empty())
+            return in_tail_;
+        size_t total = 0;
+        for (size_t i = 0; i != members_.size(); ++i) {
+            members_[i].out_pos = total;
+            total += members_[i].out_size;
+        }
+        output_.resize(total);
+#if XYLIB_USE_STD_MUTEX
+        size_t n = std::min((size_t) n_threads_, members_.size());
+        ThreadGroup group;
+        size_t started = 1;
+        try {
+            for (; started < n; ++started)
+                group.threads.push_back(std::thread(inflate_members, this,
+                                                    started, n));
+        } catch (std::system_error&) {
+            // can't start more threads, the rest is inflated here
+        }
+        for (size_t i = started; i < n; ++i)
+            inflate_members(this, i, n);
+        inflate_members(this, 0, n);
+        group.join();
+#else
+        inflate_members(this, 0, 1);
+#endif
+        for (size_t i = 0; i != members_.size(); ++i)
+            if (members_[i].error != NULL)
+                fail(members_[i].error);
+        return true;
+    }
+
+#if XYLIB_USE_STD_MUTEX
+    // joins the threads also if an exception is thrown
+    struct ThreadGroup
+    {
+        std::vector<std::thread> threads;
+        ~ThreadGroup() { join(); }
+        void join()
+        {
+            for (size_t i = 0; i != threads.size(); ++i)
+                if (threads[i].joinable())
+                    threads[i].join();
+        }
+    };
+#endif
+
+    // inflates members first, first+step, first+2*step, ...
+    static void inflate_members(gzip_istreambuf* self,
+                                size_t first, size_t step)
+    {
+        for (size_t i = first; i < self->members_.size(); i += step) {
+            Member& m = self->members_[i];
+            z_stream zs;
+            memset(&zs, 0, sizeof(zs));
+            // 16+: gzip header and trailer are checked by zlib
+            if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+                m.error = "can't initialize zlib";
+                continue;
+            }
+            char empty; // EOF marker block is empty
+            zs.next_in = (Bytef*) &self->input_[m.in_pos];
+            zs.avail_in = (uInt) m.in_size;
+            zs.next_out = (Bytef*) (m.out_size != 0 ? &self->output_[m.out_pos]
+                                                    : &empty);
+            zs.avail_out = (uInt) (m.out_size != 0 ? m.out_size : 1);
+            int r = inflate(&zs, Z_FINISH);
+            if (r != Z_STREAM_END || zs.total_out != m.out_size)
+                m.error = (zs.msg != NULL ? zs.msg : "corrupted BGZF block");
+            inflateEnd(&zs);
+        }
+    }
+
+    // Called after read_member() failed. If it wasn't the end of file,
+    // the bytes left in input_ start the tail that is inflated by zs_.
+    void start_tail()
+    {
+        size_t pos = 0;
+        if (!members_.empty())
+            pos = members_.back().in_pos + members_.back().in_size;
+        if (in_.error())
+            fail("read error");
+        if (pos == input_.size())
+            return;
+        tail_.assign(input_.begin() + pos, input_.end());
+        input_.resize(pos);
+        memset(&zs_, 0, sizeof(zs_));
+        if (inflateInit2(&zs_, 16 + MAX_WBITS) != Z_OK)
+            fail("can't initialize zlib");
+        zs_.next_in = (Bytef*) &tail_[0];
+        zs_.avail_in = (uInt) tail_.size();
+        in_tail_ = true;
+        member_done_ = false;
+        tail_end_ = false;
+    }
+
+    // Inflates the tail of the file, gzip members one after another.
+    // Like in gzread(), data after a member that doesn't look like gzip
+    // is ignored.
+    int inflate_tail(char* buf, int size)
+    {
+        zs_.next_out = (Bytef*) buf;
+        zs_.avail_out = (uInt) size;
+        while (zs_.avail_out != 0 && !tail_end_) {
+            if (zs_.avail_in == 0) {
+                tail_.resize(kTailChunk);
+                size_t n = in_.read(&tail_[0], tail_.size());
+                if (in_.error())
+                    fail("read error");
+                if (n == 0) {
+                    if (!member_done_)
+                        fail("unexpected end of file");
+                    break;
+                }
+                zs_.next_in = (Bytef*) &tail_[0];
+                zs_.avail_in = (uInt) n;
+            }
+            if (member_done_) {
+                if (zs_.next_in[0] != 0x1f) {
+                    tail_end_ = true;
+                    break;
+                }
+                inflateReset(&zs_);
+                member_done_ = false;
+            }
+            int r = inflate(&zs_, Z_NO_FLUSH);
+            if (r == Z_STREAM_END)
+                member_done_ = true;
+            else if (r != Z_OK)
+                fail(zs_.msg != NULL ? zs_.msg : "corrupted data");
+        }
+        return size - (int) zs_.avail_out;
     }
 };
 #endif
 
 #ifdef HAVE_LIBBZ2
-struct bzip2_istreambuf : public decompressing_istreambuf
+class bzip2_istreambuf : public decompressing_istreambuf
 {
-    explicit bzip2_istreambuf(BZFILE* bz2)
+public:
+    explicit bzip2_istreambuf(InputFile& in) : in_(in), bz2_(NULL)
     {
-        for (;;) {
-            int n = BZ2_bzread(bz2, writeptr_, bufavail_);//the only difference
-            writeptr_ += n;
-            if (n != bufavail_)
+        if (!open())
+            throw RunTimeError("can't open .bz2 input file");
+    }
+    ~bzip2_istreambuf()
+    {
+        stop_reading();
+        close();
+    }
+
+protected:
+    int read_raw(char* buf, int size)
+    {
+        int total = 0;
+        while (bz2_ != NULL && total < size) {
+            int n = BZ2_bzread(bz2_, buf + total, size - total);
+            if (n < 0) {
+                int err;
+                throw RunTimeError(string("error while reading .bz2 file: ")
+                                   + BZ2_bzerror(bz2_, &err));
+            }
+            if (n == 0)
                 break;
-            double_buf();
+            total += n;
         }
-        setg(bufdata_, bufdata_, writeptr_);
+        return total;
+    }
+
+    // bzip2 can't rewind, the decompression is started again
+    bool rewind_raw()
+    {
+        close();
+        return in_.rewind() && open();
+    }
+
+private:
+    InputFile& in_;
+    BZFILE* bz2_;
+
+    // libbz2 reads the FILE itself, the bytes put back in InputFile
+    // are passed as "unused" data
+    bool open()
+    {
+        char unused[BZ_MAX_UNUSED];
+        int n = (int) in_.read_prefix(unused, sizeof(unused));
+        int err;
+        bz2_ = BZ2_bzReadOpen(&err, in_.file(), 0, 0, unused, n);
+        return bz2_ != NULL;
+    }
+
+    void close()
+    {
+        int err;
+        if (bz2_ != NULL)
+            BZ2_bzReadClose(&err, bz2_);
+        bz2_ = NULL;
     }
 };
 #endif
 
+#if defined(HAVE_LIBLZMA) || defined(HAVE_LIBZSTD) || defined(HAVE_LIBLZ4)
+// Base for codecs that decompress memory buffers: the compressed file
+// is read in blocks and passed to decode().
+class buffer_decompressing_istreambuf : public decompressing_istreambuf
+{
+public:
+    // ext is used in error messages
+    buffer_decompressing_istreambuf(InputFile& file, const char* ext)
+        : error_(NULL), file_(file), ext_(ext), input_(kInputSize),
+          in_(NULL), in_end_(NULL), eof_(false), complete_(false)
+    {}
+
+protected:
+    enum DecodeStatus
+    {
+        kDecodeOk,    // more data is expected
+        kDecodeEnd,   // a stream (frame) is complete, the data may end here
+        kDecodeError  // the data is corrupted, error_ tells why
+    };
+
+    // Decompresses data from [in, in_end) to [out, out_end) advancing
+    // in and out; finish is set after the last block of the file.
+    virtual DecodeStatus decode(const char*& in, const char* in_end,
+                                char*& out, char* out_end, bool finish) = 0;
+    virtual bool reset_decoder() = 0;
+
+    const char* error_; // set by decode() when it returns kDecodeError
+
+    int read_raw(char* buf, int size)
+    {
+        char* out = buf;
+        char* out_end = buf + size;
+        while (out < out_end) {
+            if (in_ == in_end_ && !eof_) {
+                size_t n = file_.read(&input_[0], input_.size());
+                if (file_.error())
+                    fail("read error");
+                in_ = &input_[0];
+                in_end_ = in_ + n;
+                eof_ = (n < input_.size());
+            }
+            const char* prev_in = in_;
+            char* prev_out = out;
+            DecodeStatus st = decode(in_, in_end_, out, out_end, eof_);
+            if (st == kDecodeError)
+                fail(error_);
+            if (in_ != prev_in || out != prev_out)
+                complete_ = (st == kDecodeEnd);
+            else if (st == kDecodeEnd || (eof_ && in_ == in_end_)) {
+                // no progress: either all is done or the file is truncated
+                if (!complete_ && st != kDecodeEnd)
+                    fail("unexpected end of file");
+                break;
+            }
+            else
+                fail("decoder is stuck");
+        }
+        return (int) (out - buf);
+    }
+
+    bool rewind_raw()
+    {
+        in_ = in_end_ = NULL;
+        eof_ = false;
+        complete_ = false;
+        return file_.rewind() && reset_decoder();
+    }
+
+private:
+    static const size_t kInputSize = 64 * 1024;
+    InputFile& file_;
+    const char* ext_;
+    std::vector<char> input_;
+    const char* in_;
+    const char* in_end_;
+    bool eof_;
+    bool complete_; // the last decoded data ended a stream (frame)
+
+    void fail(const char* msg) const
+    {
+        throw RunTimeError(string("error while reading ") + ext_ + " file: "
+                           + msg);
+    }
+};
+#endif
+
+#ifdef HAVE_LIBLZMA
+class xz_istreambuf : public buffer_decompressing_istreambuf
+{
+public:
+    explicit xz_istreambuf(InputFile& f)
+        : buffer_decompressing_istreambuf(f, ".xz")
+    {
+        lzma_stream init = LZMA_STREAM_INIT;
+        strm_ = init;
+        if (!reset_decoder()) {
+            lzma_end(&strm_);
+            throw RunTimeError("can't initialize xz decoder");
+        }
+    }
+    ~xz_istreambuf()
+    {
+        stop_reading();
+        lzma_end(&strm_);
+    }
+
+protected:
+    DecodeStatus decode(const char*& in, const char* in_end,
+                        char*& out, char* out_end, bool finish)
+    {
+        strm_.next_in = (const uint8_t*) in;
+        strm_.avail_in = in_end - in;
+        strm_.next_out = (uint8_t*) out;
+        strm_.avail_out = out_end - out;
+        lzma_ret r = lzma_code(&strm_, finish ? LZMA_FINISH : LZMA_RUN);
+        in = (const char*) strm_.next_in;
+        out = (char*) strm_.next_out;
+        switch (r) {
+            case LZMA_OK: return kDecodeOk;
+            case LZMA_STREAM_END: return kDecodeEnd;
+            case LZMA_MEM_ERROR: error_ = "out of memory"; break;
+            case LZMA_FORMAT_ERROR: error_ = "not in .xz format"; break;
+            case LZMA_DATA_ERROR: error_ = "corrupted data"; break;
+            case LZMA_BUF_ERROR: error_ = "unexpected end of file"; break;
+            default: error_ = "decoder error"; break;
+        }
+        return kDecodeError;
+    }
+
+    // LZMA_CONCATENATED: read all streams, like xz -d does
+    bool reset_decoder()
+    {
+        return lzma_stream_decoder(&strm_, UINT64_MAX, LZMA_CONCATENATED)
+                                                                == LZMA_OK;
+    }
+
+private:
+    lzma_stream strm_;
+};
+#endif
+
+#ifdef HAVE_LIBZSTD
+class zstd_istreambuf : public buffer_decompressing_istreambuf
+{
+public:
+    explicit zstd_istreambuf(InputFile& f)
+        : buffer_decompressing_istreambuf(f, ".zst"),
+          ds_(ZSTD_createDStream())
+    {
+        if (ds_ == NULL || !reset_decoder()) {
+            ZSTD_freeDStream(ds_);
+            throw RunTimeError("can't initialize zstd decoder");
+        }
+    }
+    ~zstd_istreambuf()
+    {
+        stop_reading();
+        ZSTD_freeDStream(ds_);
+    }
+
+protected:
+    // consecutive frames are decompressed one after another
+    DecodeStatus decode(const char*& in, const char* in_end,
+                        char*& out, char* out_end, bool /*finish*/)
+    {
+        ZSTD_inBuffer ib = { in, (size_t) (in_end - in), 0 };
+        ZSTD_outBuffer ob = { out, (size_t) (out_end - out), 0 };
+        size_t r = ZSTD_decompressStream(ds_, &ob, &ib);
+        in += ib.pos;
+        out += ob.pos;
+        if (ZSTD_isError(r)) {
+            error_ = ZSTD_getErrorName(r);
+            return kDecodeError;
+        }
+        return r == 0 ? kDecodeEnd : kDecodeOk;
+    }
+
+    bool reset_decoder() { return !ZSTD_isError(ZSTD_initDStream(ds_)); }
+
+private:
+    ZSTD_DStream* ds_;
+};
+#endif
+
+#ifdef HAVE_LIBLZ4
+class lz4_istreambuf : public buffer_decompressing_istreambuf
+{
+public:
+    explicit lz4_istreambuf(InputFile& f)
+        : buffer_decompressing_istreambuf(f, ".lz4"), ctx_(NULL)
+    {
+        if (!reset_decoder())
+            throw RunTimeError("can't initialize lz4 decoder");
+    }
+    ~lz4_istreambuf()
+    {
+        stop_reading();
+        LZ4F_freeDecompressionContext(ctx_);
+    }
+
+protected:
+    // consecutive frames are decompressed one after another
+    DecodeStatus decode(const char*& in, const char* in_end,
+                        char*& out, char* out_end, bool /*finish*/)
+    {
+        size_t in_size = in_end - in;
+        size_t out_size = out_end - out;
+        size_t r = LZ4F_decompress(ctx_, out, &out_size, in, &in_size, NULL);
+        in += in_size;
+        out += out_size;
+        if (LZ4F_isError(r)) {
+            error_ = LZ4F_getErrorName(r);
+            return kDecodeError;
+        }
+        return r == 0 ? kDecodeEnd : kDecodeOk;
+    }
+
+    // the context is created again, LZ4F_resetDecompressionContext()
+    // is not available in older versions of liblz4
+    bool reset_decoder()
+    {
+        if (ctx_ != NULL)
+            LZ4F_freeDecompressionContext(ctx_);
+        ctx_ = NULL;
+        LZ4F_errorCode_t r = LZ4F_createDecompressionContext(&ctx_,
+                                                             LZ4F_VERSION);
+        return !LZ4F_isError(r);
+    }
+
+private:
+    LZ4F_decompressionContext_t ctx_;
+};
+#endif
+
+
+// Read-only memory mapping of a whole file. If the file can't be mapped
+// (it's empty, not a regular file, mmap is not available, etc.) data()
+// returns NULL and the file should be read as a stream.
+class MappedFile
+{
+public:
+#if defined(_WIN32)
+    explicit MappedFile(const wchar_t* path);
+#else
+    explicit MappedFile(const char* path);
+#endif
+    ~MappedFile();
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const char* data_;
+    size_t size_;
+#if defined(_WIN32)
+    HANDLE mapping_;
+#endif
+
+    MappedFile(const MappedFile&); // disallow
+    void operator=(const MappedFile&); // disallow
+};
+
+#if defined(_WIN32)
+MappedFile::MappedFile(const wchar_t* path)
+    : data_(NULL), size_(0), mapping_(NULL)
+{
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+            (ULONGLONG) size.QuadPart <= (size_t) -1) {
+        // the mapping keeps the file open
+        mapping_ = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping_ != NULL) {
+            data_ = (const char*) MapViewOfFile(mapping_, FILE_MAP_READ,
+                                                0, 0, 0);
+            if (data_ != NULL)
+                size_ = (size_t) size.QuadPart;
+        }
+    }
+    CloseHandle(file);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data_ != NULL)
+        UnmapViewOfFile(data_);
+    if (mapping_ != NULL)
+        CloseHandle(mapping_);
+}
+
+#else
+MappedFile::MappedFile(const char* path)
+    : data_(NULL), size_(0)
+{
+#if defined(HAVE_MMAP)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+            (boost::uintmax_t) st.st_size <= (size_t) -1) {
+        void* p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+                       fd, 0);
+        if (p != MAP_FAILED) {
+            data_ = (const char*) p;
+            size_ = (size_t) st.st_size;
+        }
+    }
+    close(fd);
+#else
+    (void) path;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#if defined(HAVE_MMAP)
+    if (data_ != NULL)
+        munmap(const_cast<char*>(data_), size_);
+#endif
+}
+#endif // _WIN32
+
 
 DataSet* guess_and_load_stream(istream &is,
                                string const& path, // only used for guessing
@@ -522,8 +1959,9 @@ DataSet* guess_and_load_stream(istream &is,
         fi = guess_filetype(path, is, NULL);
         if (!fi)
             throw RunTimeError ("Format of the file can not be guessed");
-        is.seekg(0);
         is.clear();
+        if (!is.seekg(0))
+            throw RunTimeError("can't rewind the input after guessing");
     }
     else {
         fi = (FormatInfo const*) xylib_get_format_by_name(format_name.c_str());
@@ -549,57 +1987,146 @@ bool is_directory(string const& path)
     // could use PathIsDirectory() on Windows
 }
 
+namespace {
+
+enum Compression { kNotCompressed, kGzip, kBzip2, kXz, kZstd, kLz4 };
+
+// Recognizes compressed files by the magic bytes at the beginning.
+// The file is then rewound, or the bytes are put back if it's a pipe.
+Compression detect_compression(InputFile& in)
+{
+    unsigned char h[16] = { 0 };
+    size_t n = in.read((char*) h, sizeof(h));
+    if (!in.rewind())
+        in.unread((const char*) h, n);
+    if (n >= 2 && h[0] == 0x1f && h[1] == 0x8b)
+        return kGzip;
+    if (n >= 4 && memcmp(h, "BZh", 3) == 0 && h[3] >= '1' && h[3] <= '9')
+        return kBzip2;
+    if (n >= 6 && memcmp(h, "\xFD" "7zXZ\0", 6) == 0)
+        return kXz;
+    if (n >= 4 && memcmp(h, "\x28\xB5\x2F\xFD", 4) == 0)
+        return kZstd;
+    if (n >= 4 && memcmp(h, "\x04\x22\x4D\x18", 4) == 0)
+        return kLz4;
+    return kNotCompressed;
+}
+
+// path without the extension of a compressed file (foo.xy.gz -> foo.xy),
+// used for guessing the format
+string strip_compression_ext(string const& path)
+{
+    static const char* exts[] = { ".gz", ".bz2", ".xz", ".zst", ".lz4", NULL };
+    for (const char** e = exts; *e != NULL; ++e) {
+        size_t n = strlen(*e);
+        if (path.size() > n && path.compare(path.size() - n, n, *e) == 0)
+            return path.substr(0, path.size() - n);
+    }
+    return path;
+}
+
+DataSet* load_decompressed(std::streambuf* buf, string const& guess_path,
+                           string const& format_name, string const& options)
+{
+    istream is(buf);
+    // errors of decompression are thrown from the streambuf; with badbit
+    // in the mask istream passes them on instead of just setting badbit
+    is.exceptions(ios::badbit);
+    return guess_and_load_stream(is, guess_path, format_name, options);
+}
+
+} // anonymous namespace
+
 DataSet* load_file(string const& path, string const& format_name,
                    string const& options)
 {
-    int len = (int)path.size();
 #if defined(_WIN32)
+    int len = (int)path.size();
     vector<wchar_t> wpath;
     //MultiByteToWideChar(CP_UTF8, 0, path.c_str(), path.size(), 0, 0);
     wpath.resize(len + 1); // should be enough
     MultiByteToWideChar(CP_UTF8, 0, path.c_str(), len, &wpath[0], len);
 #endif
     DataSet *ret = NULL;
-    // open stream
-    bool gzipped = (len > 3 && path.substr(len-3) == ".gz");
-    bool bz2ed = (len > 4 && path.substr(len-4) == ".bz2");
-    if ((gzipped && len > 7 && path.substr(len-7) == ".tar.gz") ||
-            (bz2ed && len > 8 && path.substr(len-8) == ".tar.bz2"))
+    string guess_path = strip_compression_ext(path);
+    if (guess_path != path && guess_path.size() > 4 &&
+            guess_path.substr(guess_path.size() - 4) == ".tar")
         throw RunTimeError("Refusing to read a tarball: " + path);
-    if (is_directory(path)) {
+    if (is_directory(path))
         throw RunTimeError("It is a directory, not a file: " + path);
-    } else if (gzipped) {
-#ifdef HAVE_LIBZ
+
+    // compression is detected from the content, not from the extension
 #if defined(_WIN32)
-        gzFile gz_stream = gzopen_w(&wpath[0], "rb");
+    FILE* f = _wfopen(&wpath[0], L"rb");
 #else
-        gzFile gz_stream = gzopen(path.c_str(), "rb");
+    FILE* f = fopen(path.c_str(), "rb");
 #endif
-        if (!gz_stream) {
-            throw RunTimeError("can't open .gz input file: " + path);
-        }
-        gzip_istreambuf istrbuf(gz_stream);
-        istream is(&istrbuf);
-        ret = guess_and_load_stream(is, path.substr(0, len-3),
-                                    format_name, options);
+    if (f == NULL)
+        throw RunTimeError("can't open input file: " + path);
+    // pipes can't be rewound and must not be opened again
+    InputFile in(f, fseek(f, 0, SEEK_SET) == 0);
+    Compression compression = detect_compression(in);
+    if (compression == kGzip) {
+#ifdef HAVE_LIBZ
+        gzip_istreambuf istrbuf(in);
+        ret = load_decompressed(&istrbuf, guess_path, format_name, options);
 #else
         throw RunTimeError("Program is compiled with disabled zlib support.");
 #endif //HAVE_LIBZ
-    } else if (bz2ed) {
+    } else if (compression == kBzip2) {
 #ifdef HAVE_LIBBZ2
-        // not used much on Windows I suppose
-        BZFILE* bz_stream = BZ2_bzopen(path.c_str(), "rb");
-        if (!bz_stream) {
-            throw RunTimeError("can't open .bz2 input file: " + path);
-        }
-        bzip2_istreambuf istrbuf(bz_stream);
-        istream is(&istrbuf);
-        ret = guess_and_load_stream(is, path.substr(0, len-3),
-                                    format_name, options);
+        bzip2_istreambuf istrbuf(in);
+        ret = load_decompressed(&istrbuf, guess_path, format_name, options);
 #else
         throw RunTimeError("Program is compiled with disabled bzlib support.");
 #endif //HAVE_LIBBZ2
+    } else if (compression == kXz) {
+#ifdef HAVE_LIBLZMA
+        xz_istreambuf istrbuf(in);
+        ret = load_decompressed(&istrbuf, guess_path, format_name, options);
+#else
+        throw RunTimeError("Program is compiled with disabled xz support.");
+#endif
+    } else if (compression == kZstd) {
+#ifdef HAVE_LIBZSTD
+        zstd_istreambuf istrbuf(in);
+        ret = load_decompressed(&istrbuf, guess_path, format_name, options);
+#else
+        throw RunTimeError("Program is compiled with disabled zstd support.");
+#endif
+    } else if (compression == kLz4) {
+#ifdef HAVE_LIBLZ4
+        lz4_istreambuf istrbuf(in);
+        ret = load_decompressed(&istrbuf, guess_path, format_name, options);
+#else
+        throw RunTimeError("Program is compiled with disabled lz4 support.");
+#endif
+    } else if (!in.seekable()) {
+        // the whole pipe is read to memory
+        string data;
+        char buf[65536];
+        size_t n;
+        while ((n = in.read(buf, sizeof(buf))) != 0)
+            data.append(buf, n);
+        if (in.error())
+            throw RunTimeError("can't read input file: " + path);
+        MemoryStreambuf mbuf(data.data(), data.size());
+        istream is(&mbuf);
+        ret = guess_and_load_stream(is, guess_path, format_name, options);
     } else {
+        // readers get the content of the file from the mapping, without
+        // copying it to stream buffers (see get_memory_view())
+#if defined(_WIN32)
+        MappedFile mapped(&wpath[0]);
+#else
+        MappedFile mapped(path.c_str());
+#endif
+        if (mapped.data() != NULL) {
+            MemoryStreambuf buf(mapped.data(), mapped.size());
+            istream is(&buf);
+            return guess_and_load_stream(is, guess_path, format_name,
+                                         options);
+        }
 #if defined(_MSC_VER)
         ifstream is(&wpath[0], ios::in | ios::binary);
 #elif defined(_WIN32) && defined(__GLIBCXX__)
@@ -616,7 +2143,7 @@ DataSet* load_file(string const& path, string const& format_name,
 #endif
         if (!is)
             throw RunTimeError("can't open input file: " + path);
-        ret = guess_and_load_stream(is, path, format_name, options);
+        ret = guess_and_load_stream(is, guess_path, format_name, options);
 #if defined(_WIN32) && defined(__GLIBCXX__)
         } catch (...) {
             fclose(c_file);
@@ -640,8 +2167,15 @@ DataSet* load_stream(istream &is, string const& format_name,
 DataSet* load_string(string const& buffer, string const& format_name,
                      string const& options)
 {
-    istringstream iss(buffer);
-    return load_stream(iss, format_name, options);
+    return load_memory(buffer.data(), buffer.size(), format_name, options);
+}
+
+DataSet* load_memory(const void* data, size_t size, string const& format_name,
+                     string const& options)
+{
+    MemoryStreambuf buf((const char*) data, size);
+    istream is(&buf);
+    return guess_and_load_stream(is, "", format_name, options);
 }
 
 
@@ -671,8 +2205,9 @@ FormatInfo const* guess_filetype(const string &path, istream &f,
                                                 i != possible.end(); ++i) {
         if (check_format(*i, f, details))
             return *i;
-        f.seekg(0);
         f.clear();
+        if (!f.seekg(0))
+            throw RunTimeError("can't rewind the input after guessing");
     }
     return NULL;
 }
@@ -56,9 +56,14 @@
  */
 #define XYLIB_VERSION 10600 /* 1.6.0 */
 
+#include <stddef.h> /* ptrdiff_t */
+
 #ifdef __cplusplus
 
+#include <iterator>
 #include <string>
+#include <utility>
+#include <vector>
 #include <stdexcept>
 #include <fstream>
 
@@ -76,6 +81,10 @@ struct XYLIB_API xylibFormat
     const char* valid_options; /** NULL or options separated by spaces */
 };
 
+/* Type of point indices and counts in the 64-bit API (functions with
+ * suffix 64); it has 64 bits on 64-bit platforms. */
+typedef ptrdiff_t xylib_index_t;
+
 /* Three functions below are a part of C API which is useful also in C++.  */
 
 /* returns version of the library; see also XYLIB_VERSION */
@@ -98,6 +107,11 @@ XYLIB_API const struct xylibFormat* xylib_get_format_by_name(const char* name);
 XYLIB_API void* xylib_load_file(const char* path, const char* format_name,
                                 const char* options);
 
+/* C equivalent of xylib::load_memory */
+XYLIB_API void* xylib_load_memory(const void* data, size_t size,
+                                  const char* format_name,
+                                  const char* options);
+
 /* C equivalent of xylib::DataSet::get_block() */
 XYLIB_API void* xylib_get_block(void* dataset, int block);
 
@@ -110,6 +124,33 @@ XYLIB_API int xylib_count_rows(void* block, int column);
 /* C equivalent of xylib::Column::get_value() */
 XYLIB_API double xylib_get_data(void* block, int column, int row);
 
+/* C equivalent of xylib::Column::get_values(),
+ * returns 0 on success and -1 if column or rows are out of range */
+XYLIB_API int xylib_get_values(void* block, int column, int first, int count,
+                               double* out);
+
+/* 64-bit variants of xylib_count_rows(), xylib_get_data()
+ * and xylib_get_values() */
+XYLIB_API xylib_index_t xylib_count_rows64(void* block, int column);
+XYLIB_API double xylib_get_data64(void* block, int column, xylib_index_t row);
+XYLIB_API int xylib_get_values64(void* block, int column, xylib_index_t first,
+                                 xylib_index_t count, double* out);
+
+/* Takes values out of the column (see xylib::Block::release_values())
+ * and returns them as a buffer that must be freed by xylib_free_buffer().
+ * The column is left empty. If the values can't be moved out, they are
+ * copied. Returns NULL if the column is out of range. */
+XYLIB_API void* xylib_release_values(void* block, int column);
+
+/* number of values in the buffer from xylib_release_values() */
+XYLIB_API xylib_index_t xylib_buffer_size(void* buffer);
+
+/* pointer to values in the buffer from xylib_release_values() */
+XYLIB_API const double* xylib_buffer_data(void* buffer);
+
+/* destruct buffer created by xylib_release_values() */
+XYLIB_API void xylib_free_buffer(void* buffer);
+
 /* C equivalent of xylib::MetaData::get() */
 XYLIB_API const char* xylib_dataset_metadata(void* dataset, const char* key);
 
@@ -160,12 +201,58 @@ public:
 };
 
 
+/// type in which column values are kept in memory,
+/// get_value() and get_values() always convert them to double
+enum NativeType
+{
+    kNativeNone,    // values are not stored in an array (e.g. computed)
+    kNativeDouble,
+    kNativeFloat,
+    kNativeInt16,
+    kNativeUInt16,
+    kNativeInt32,
+    kNativeUInt32
+};
+
+/// how values of a column are represented, see Column::get_kind()
+enum ColumnKind
+{
+    kColumnOther,   // values available only through virtual functions
+    kColumnArray,   // contiguous array of doubles, see get_data_pointer()
+    kColumnStep     // fixed step: value of n'th point is start + n * step
+};
+
+struct ColumnView;
+
+/// statistics of column values, see Column::get_stats()
+struct XYLIB_API ColumnStats
+{
+    double min;     /// minimum value, NaNs are skipped (0 if no values)
+    double max;     /// maximum value, NaNs are skipped (0 if no values)
+    double sum;     /// sum of values that are not NaN
+    xylib_index_t nan_count; /// number of NaN values
+    int monotonic;  /// 1 - values never decrease, -1 - never increase, 0 - none
+};
+
+/// Source of memory for arenas of datasets, see set_arena_allocation()
+class XYLIB_API Allocator
+{
+public:
+    virtual ~Allocator() {}
+    virtual void* allocate(size_t size) = 0;
+    virtual void deallocate(void* ptr, size_t size) = 0;
+};
+
 /// abstract base class for a column
 class XYLIB_API Column
 {
 public:
     virtual ~Column() {}
 
+    // columns can be allocated from an arena (see set_arena_allocation())
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+
     /// Column can have a name (but usually it doesn't have)
     virtual std::string const& get_name() const = 0;
 
@@ -185,6 +272,87 @@ public:
 
     /// returns step in the case of fixed step, 0. otherwise
     virtual double get_step() const = 0;
+
+    /// get min, max, sum, number of NaNs and monotonicity in one pass;
+    /// columns that store values cache the result, so calling it
+    /// repeatedly is cheap; point_count is used as in get_max()
+    virtual ColumnStats get_stats(int point_count=0) const;
+
+    /// return indices [first, last) of points with lo <= value <= hi,
+    /// without copying the data; for monotonic columns a formula or binary
+    /// search is used, other columns are scanned and the smallest range
+    /// that contains all such points is returned; point_count is used
+    /// as in get_max()
+    virtual std::pair<int,int> find_range(double lo, double hi,
+                                          int point_count=0) const;
+
+    /// copy values of points first, first+1, ..., first+count-1 to out;
+    /// it is much faster than calling get_value() for each point
+    virtual void get_values(int first, int count, double* out) const;
+
+    /// return pointer to all values if they are stored in memory as
+    /// a contiguous array of doubles, NULL otherwise;
+    /// the pointer is valid as long as the column is not modified
+    virtual const double* get_data_pointer() const { return NULL; }
+
+    /// return the type in which values are stored in memory
+    virtual NativeType get_native_type() const { return kNativeNone; }
+
+    /// 64-bit variants of get_point_count(), get_value() and get_values(),
+    /// for columns with more than 2^31 points (for which get_point_count()
+    /// returns INT_MAX)
+    virtual xylib_index_t get_point_count64() const
+                                                { return get_point_count(); }
+    virtual double get_value64(xylib_index_t n) const;
+    virtual void get_values64(xylib_index_t first, xylib_index_t count,
+                              double* out) const;
+
+    /// move values to out (without copying) and leave the column empty;
+    /// returns false and does nothing if values are not stored as doubles
+    virtual bool release_data(std::vector<double>& /*out*/) { return false; }
+
+    /// free unused capacity of buffers; load_file() calls it for all columns
+    virtual void shrink_to_fit() {}
+
+    /// approximate memory used by the column, in bytes, including unused
+    /// capacity of buffers; columns defined outside of xylib should
+    /// override it
+    virtual size_t memory_bytes() const { return sizeof(Column); }
+
+    /// return representation of values; it's not virtual, so it's cheap
+    ColumnKind get_kind() const { return kind_; }
+
+    /// return view with non-virtual inline access to values,
+    /// valid as long as the column is not modified
+    ColumnView get_view() const;
+
+protected:
+    explicit Column(ColumnKind kind=kColumnOther) : kind_(kind) {}
+
+private:
+    ColumnKind kind_;
+};
+
+/// Plain description of column values (see Column::get_view()).
+/// In tight loops check kind once and read data[n] or start + n * step
+/// directly; operator[] handles all kinds.
+struct XYLIB_API ColumnView
+{
+    ColumnKind kind;
+    int count;              /// number of points, -1 means "unlimited"
+    const double* data;     /// values if kind is kColumnArray, NULL otherwise
+    double start;           /// the first value if kind is kColumnStep
+    double step;            /// step, as returned by Column::get_step()
+    const Column* column;   /// the column itself, for kColumnOther
+
+    double operator[](int n) const
+    {
+        switch (kind) {
+            case kColumnArray: return data[n];
+            case kColumnStep: return start + step * n;
+            default: return column->get_value(n);
+        }
+    }
 };
 
 
@@ -195,15 +363,67 @@ struct DataSetImp;
 
 /// Map that stores meta-data (additional data, that usually describe x-y data)
 /// for block or dataset. For example: date of the experiment, wavelength, ...
-/// The only way to get all elements is using size(), get_key() and get().
+/// Elements are sorted by key. All elements can be iterated either with
+/// begin() and end() or using size(), get_key() and get_value().
 class XYLIB_API MetaData
 {
 public:
+    /// key-value pair, as returned by const_iterator
+    struct Item
+    {
+        std::string const& key;
+        std::string const& value;
+    };
+
+    /// iterator over key-value pairs; the pairs are returned by value,
+    /// so it's an input iterator
+    class const_iterator
+    {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef Item value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Item reference;
+        // makes it->key work, although there is no Item to point to
+        class pointer
+        {
+        public:
+            explicit pointer(Item const& item) : item_(item) {}
+            Item const* operator->() const { return &item_; }
+        private:
+            Item item_;
+        };
+
+        const_iterator(MetaData const* md, size_t index)
+            : md_(md), index_(index) {}
+        std::string const& key() const { return md_->get_key(index_); }
+        std::string const& value() const { return md_->get_value(index_); }
+        reference operator*() const { Item item = { key(), value() };
+                                      return item; }
+        pointer operator->() const { return pointer(**this); }
+        const_iterator& operator++() { ++index_; return *this; }
+        const_iterator operator++(int)
+                        { const_iterator old = *this; ++index_; return old; }
+        bool operator==(const_iterator const& other) const
+                                            { return index_ == other.index_; }
+        bool operator!=(const_iterator const& other) const
+                                            { return index_ != other.index_; }
+    private:
+        MetaData const* md_;
+        size_t index_;
+    };
+
     // use these functions to query meta data
     bool has_key(std::string const& key) const;
     std::string const& get(std::string const& key) const;
     size_t size() const;
     std::string const& get_key(size_t index) const;
+    std::string const& get_value(size_t index) const;
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+    /// approximate memory used, in bytes; keys shared with other blocks
+    /// are counted in part
+    size_t memory_bytes() const;
 
     // functions for use only in xylib
     MetaData();
@@ -216,7 +436,12 @@ public:
 private:
     MetaData(const MetaData&); // disallow
 
-    MetaDataImp *imp_;
+    // MetaDataImp is constructed in this fixed-size buffer, so MetaData
+    // doesn't allocate memory by itself (the size is checked in xylib.cpp)
+    void* imp_buf_[8];
+    MetaDataImp* imp() { return reinterpret_cast<MetaDataImp*>(imp_buf_); }
+    const MetaDataImp* imp() const
+                { return reinterpret_cast<const MetaDataImp*>(imp_buf_); }
 };
 
 
@@ -232,6 +457,10 @@ public:
     Block();
     ~Block();
 
+    // blocks can be allocated from an arena (see set_arena_allocation())
+    static void* operator new(size_t size);
+    static void operator delete(void* ptr);
+
     /// block can have a name (but usually it doesn't have)
     std::string const& get_name() const;
 
@@ -244,9 +473,39 @@ public:
     /// each column should have the same number of points (or "unlimited"
     /// number if the column is a generator)
     int get_point_count() const;
+    /// 64-bit variant of get_point_count()
+    xylib_index_t get_point_count64() const;
+
+    /// return indices [first, last) of points with values in column n
+    /// between lo and hi, see Column::find_range()
+    std::pair<int,int> find_range(int n, double lo, double hi) const;
+
+    /// approximate memory used by the block and its columns, in bytes
+    /// (columns shared with other blocks are included)
+    size_t memory_bytes() const;
+
+    /// return a copy of the block that shares columns and meta-data
+    /// with this block; shared columns are never modified (release_values()
+    /// replaces them) and meta-data is copied when it's modified
+    /// (copy-on-write)
+    Block* clone() const;
+
+    /// move values of column n to out and leave the column empty;
+    /// values are moved without copying if the column stores doubles and
+    /// is not shared with other blocks, otherwise they are copied and
+    /// the column is replaced (in this block only) by an empty one;
+    /// columns with "unlimited" number of points are not changed
+    void release_values(int n, std::vector<double>& out);
+
+    /// return new block with points [first, last) of this block;
+    /// data is not copied, columns of the new block share columns
+    /// of this block and keep them alive (this block can be deleted)
+    Block* make_slice(int first, int last) const;
 
     // functions for use in filetype implementations
     void add_column(Column* c, bool append=true);
+    /// add column n of other block, shared (not copied) with that block
+    void add_shared_column(const Block* other, int n, bool append=true);
     Column* del_column(int n); // removes and returns column
     void set_name(std::string const& name);
 
@@ -254,7 +513,20 @@ private:
     Block(const Block&); // disallow
     void operator=(const Block&); //disallow
 
-    BlockImp* imp_;
+    // BlockImp is constructed in this fixed-size buffer (as in MetaData)
+    void* imp_buf_[12];
+    BlockImp* imp() { return reinterpret_cast<BlockImp*>(imp_buf_); }
+    const BlockImp* imp() const
+                { return reinterpret_cast<const BlockImp*>(imp_buf_); }
+
+    // called after loading (frees unused memory and computes statistics)
+    void finalize_columns();
+    // memory_bytes() without columns, which can be shared by blocks
+    size_t own_memory_bytes() const;
+    friend class DataSet;
+    friend DataSet* load_stream_of_format(std::istream &is,
+                                          FormatInfo const* fi,
+                                          std::string const& options);
 };
 
 
@@ -276,6 +548,7 @@ public:
 
     /// get block n (block 0 is first)
     Block const* get_block(int n) const;
+    Block* get_block(int n);
 
     /// read data from file
     virtual void load_data(std::istream &f) = 0;
@@ -284,6 +557,16 @@ public:
     /// call load_data() more than once)
     void clear();
 
+    /// approximate memory used by the dataset (including blocks, columns
+    /// and meta-data), in bytes; a column shared by several blocks is
+    /// counted once; overhead of malloc is not included
+    size_t memory_bytes() const;
+
+    /// Return a copy of the dataset that shares data with this one, so it's
+    /// cheap. Blocks are copied with Block::clone(); the copy can be
+    /// modified or deleted in another thread.
+    DataSet* clone() const;
+
     /// check if options string has this word; t must be valid option
     bool has_option(std::string const& t);
 
@@ -298,14 +581,65 @@ public:
 
 protected:
     explicit DataSet(FormatInfo const* fi_);
+    // used by clone(), shares blocks as described there
+    DataSet(const DataSet& other);
+    // returns a copy of the object of the derived class (new T(*this)),
+    // it's defined in OBLIGATORY_DATASET_MEMBERS
+    virtual DataSet* make_copy() const = 0;
 
 private:
     DataSetImp* imp_;
-    DataSet(const DataSet&); // disallow
+    friend DataSet* load_stream_of_format(std::istream &is,
+                                          FormatInfo const* fi,
+                                          std::string const& options);
     void operator=(const DataSet&); //disallow
 };
 
 
+/// Enables or disables arena allocation for datasets that are loaded later
+/// in the calling thread. In this mode blocks and columns of a DataSet
+/// are bump-allocated from large chunks owned by the DataSet and the chunks
+/// are freed all at once in ~DataSet(). Only the objects themselves are in
+/// the arena: data arrays, strings and metadata still use the heap and
+/// their destructors still run.
+/// Chunks are obtained from `allocator' (or from malloc() if it is NULL),
+/// which must outlive the datasets.
+/// Objects taken from such a DataSet (e.g. a column removed with
+/// Block::del_column(), a copy made with Block::clone() or a slice made
+/// with Block::make_slice()) must not outlive it; DataSet::clone() shares
+/// the chunks, so they live until the last copy is deleted.
+XYLIB_API void set_arena_allocation(bool enabled, Allocator* allocator=NULL);
+
+struct LoaderContextImp;
+class LoaderContext;
+
+/// Sets context used by datasets that are loaded later in the calling thread
+/// (NULL - don't reuse buffers, the default). Loaded datasets don't use
+/// the context, it can be deleted between loads.
+XYLIB_API void set_loader_context(LoaderContext* ctx);
+
+/// Keeps scratch buffers (lines, rows of numbers, whole-file buffers and
+/// segments used when building columns) between loads, to avoid allocating
+/// them again for each file. See set_loader_context().
+/// A context should be used by one thread at a time.
+class XYLIB_API LoaderContext
+{
+public:
+    /// buffers are not kept if their total size would exceed max_bytes
+    explicit LoaderContext(size_t max_bytes = 64 * 1024 * 1024);
+    ~LoaderContext();
+    /// frees all kept buffers
+    void clear();
+    /// memory kept in buffers
+    size_t memory_bytes() const;
+
+private:
+    LoaderContextImp* imp_;
+    friend void set_loader_context(LoaderContext* ctx);
+    LoaderContext(const LoaderContext&); // disallow
+    void operator=(const LoaderContext&); //disallow
+};
+
 /// Read file from disk. Optionally supports compressed files (.gz and .bz2).
 /// Parameter path should be in utf8 (ascii also works).
 /// If format_name is not given, it is guessed.
@@ -326,6 +660,12 @@ XYLIB_API DataSet* load_string(std::string const& buffer,
                                std::string const& format_name,
                                std::string const& options="");
 
+/// Read content of a file from memory, without copying it.
+/// The memory is not used after this function returns.
+XYLIB_API DataSet* load_memory(const void* data, size_t size,
+                               std::string const& format_name,
+                               std::string const& options="");
+
 /// guess a format of the file; does NOT handle compressed files
 /// If nothing matches - returns "text" (it's a fallback, not validated here)
 XYLIB_API FormatInfo const* guess_filetype(std::string const& path,
@@ -354,6 +694,7 @@ XYLIB_API bool is_directory(std::string const& path);
         void load_data(std::istream &f); \
         static bool check(std::istream &f, std::string *details); \
         static DataSet* ctor() { return new class_name; } \
+        DataSet* make_copy() const { return new class_name(*this); } \
         static const FormatInfo fmt_info;
 #endif // BUILDING_XYLIB
 
@@ -8,10 +8,11 @@ but it is not planned due to low demand.
 """
 
 from __future__ import print_function
-from ctypes import cdll, c_char_p, c_double
+from ctypes import (cdll, c_char_p, c_double, c_int, c_size_t, c_ssize_t,
+                    c_void_p, POINTER)
 import os
 
-_dll_path = 'libxy.so.4' # platform-dependent actually
+_dll_path = 'libxy.so.5' # platform-dependent actually
 lib = cdll.LoadLibrary(_dll_path)
 
 get_version = lib.xylib_get_version
@@ -19,6 +20,11 @@ get_version.restype = c_char_p
 
 load_file = lib.xylib_load_file
 
+# load_memory(bytes_object, len(bytes_object), format_name, options)
+load_memory = lib.xylib_load_memory
+load_memory.argtypes = [c_void_p, c_size_t, c_char_p, c_char_p]
+load_memory.restype = c_void_p
+
 get_block = lib.xylib_get_block
 
 count_columns = lib.xylib_count_columns
@@ -28,6 +34,40 @@ count_rows = lib.xylib_count_rows
 get_data = lib.xylib_get_data
 get_data.restype = c_double
 
+# 64-bit variants
+count_rows64 = lib.xylib_count_rows64
+count_rows64.argtypes = [c_void_p, c_int]
+count_rows64.restype = c_ssize_t
+
+get_data64 = lib.xylib_get_data64
+get_data64.argtypes = [c_void_p, c_int, c_ssize_t]
+get_data64.restype = c_double
+
+get_values64 = lib.xylib_get_values64
+get_values64.argtypes = [c_void_p, c_int, c_ssize_t, c_ssize_t,
+                         POINTER(c_double)]
+
+# get_values(block, column, first, count, (c_double * count)())
+get_values = lib.xylib_get_values
+
+# buf = release_values(block, column); the column is emptied (values
+# are moved out if they are stored as doubles, copied otherwise),
+# values are at buffer_data(buf)[:buffer_size(buf)] until free_buffer(buf)
+release_values = lib.xylib_release_values
+release_values.argtypes = [c_void_p, c_int]
+release_values.restype = c_void_p
+
+buffer_size = lib.xylib_buffer_size
+buffer_size.argtypes = [c_void_p]
+buffer_size.restype = c_ssize_t
+
+buffer_data = lib.xylib_buffer_data
+buffer_data.argtypes = [c_void_p]
+buffer_data.restype = POINTER(c_double)
+
+free_buffer = lib.xylib_free_buffer
+free_buffer.argtypes = [c_void_p]
+
 dataset_metadata = lib.xylib_dataset_metadata
 dataset_metadata.restype = c_char_p
 